@@ -5,6 +5,9 @@
 # command=./clock.py
 # interval=60
 
+# pipebar option:
+# -e 60:./clock.py
+
 from datetime import datetime
 
 now = datetime.now()
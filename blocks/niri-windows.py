@@ -5,6 +5,9 @@
 # command=./niri-windows.py
 # interval=persist
 
+# pipebar option:
+# -e 0:./niri-windows.py
+
 import json
 import subprocess
 
@@ -5,6 +5,9 @@
 # command=./system.py
 # interval=persist
 
+# pipebar option:
+# -e 0:./system.py
+
 import psutil
 import time
 
@@ -0,0 +1,1148 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <linux/input-event-codes.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <wayland-server.h>
+
+#include "protocols/fractional-scale-server.h"
+#include "protocols/presentation-time-server.h"
+#include "protocols/viewporter-server.h"
+#include "protocols/wlr-layer-shell-server.h"
+
+#define QUEUE_SIZE 4096
+#define HISTOGRAM_BUCKETS 32
+
+enum {
+    WARNING = -1,
+    NO_ERROR = 0,
+    INNER_ERROR = 1,
+    RUNTIME_ERROR = 2,
+};
+
+enum {
+    STAT_LINE,
+    STAT_CLICK,
+    STAT_WHEEL,
+    STAT_SIZE,
+};
+
+struct queue {
+    uint64_t time[QUEUE_SIZE];
+    uint32_t head, tail;
+};
+
+struct output {
+    char* name;
+    uint32_t scale, width, height;
+    struct wl_global* wl_global;
+    struct wl_global* wl_global_removed;
+    struct wl_list resource;
+};
+
+struct buffer {
+    struct wl_resource* resource;
+    int32_t width, height;
+    bool busy;
+    uint64_t release_time;
+    struct wl_list link;
+};
+
+struct layer;
+
+struct surface {
+    struct wl_resource* resource;
+    struct buffer* pending;
+    struct buffer* current;
+    bool attached;
+    struct wl_list frame_pending, frame;
+    struct wl_list feedback_pending, feedback;
+    struct wl_resource* fractional;
+    struct layer* layer;
+    struct wl_list link;
+};
+
+struct layer {
+    struct wl_resource* resource;
+    struct surface* surface;
+    struct output* output;
+    uint32_t width, height;
+    bool configured;
+};
+
+struct harness {
+    struct wl_array output;
+    int32_t release_delay;
+    uint32_t refresh;
+    uint32_t line_interval;
+    uint32_t click_interval;
+    uint32_t wheel_interval;
+    uint32_t hotplug_interval;
+    uint32_t duration;
+    char** command;
+
+    struct wl_display* wl_display;
+    struct wl_event_loop* wl_event_loop;
+    struct wl_client* wl_client;
+    struct wl_listener wl_client_destroy;
+    struct wl_list surface;
+    struct wl_list buffer;
+    struct wl_list pointer;
+    struct surface* focus;
+    struct wl_event_source* refresh_timer;
+    struct wl_event_source* line_timer;
+    struct wl_event_source* click_timer;
+    struct wl_event_source* wheel_timer;
+    struct wl_event_source* hotplug_timer;
+    struct wl_event_source* end_timer;
+    struct wl_event_source* stdout_source;
+
+    pid_t pid;
+    int stdin_fd, stdout_fd;
+    struct wl_array stdout_buffer;
+    struct queue line, click, wheel;
+    uint64_t seq;
+    bool quit;
+    int status;
+
+    uint32_t histogram[STAT_SIZE][HISTOGRAM_BUCKETS];
+    uint64_t stat_max[STAT_SIZE];
+    uint32_t line_count, line_stall, line_merge;
+    uint32_t click_count, wheel_count, action_count;
+    uint32_t commit_count, configure_count, frame_count, present_count, discard_count;
+    uint32_t pool_create, pool_resize;
+    uint32_t buffer_create, buffer_destroy, buffer_held, buffer_held_max;
+    uint32_t hotplug_count;
+} harness;
+
+static void harness_destroy()
+{
+    if (harness.pid > 0) {
+        kill(harness.pid, SIGTERM);
+        waitpid(harness.pid, NULL, 0);
+    }
+    if (harness.wl_display != NULL) wl_display_destroy(harness.wl_display);
+    struct output** output;
+    wl_array_for_each(output, &harness.output)
+    {
+        free(*output);
+    }
+    wl_array_release(&harness.output);
+    wl_array_release(&harness.stdout_buffer);
+    if (harness.stdin_fd >= 0) close(harness.stdin_fd);
+    if (harness.stdout_fd >= 0) close(harness.stdout_fd);
+}
+
+static void msg(const int code, const char* restrict fmt, ...)
+{
+    if (fmt != NULL && fmt[0] != '\0') {
+        va_list ap;
+        va_start(ap, fmt);
+        vfprintf(stderr, fmt, ap);
+        va_end(ap);
+        fputc('\n', stderr);
+    }
+
+    if (code < NO_ERROR) return;
+
+    harness_destroy();
+    exit(code);
+}
+
+static uint64_t now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void queue_push(struct queue* queue, uint64_t time)
+{
+    if (queue->tail - queue->head == QUEUE_SIZE) queue->head++;
+    queue->time[queue->tail++ % QUEUE_SIZE] = time;
+}
+
+static void stat_record(int stat, uint64_t delta)
+{
+    uint64_t us = delta / 1000;
+    int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    harness.histogram[stat][bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1]++;
+    if (delta > harness.stat_max[stat]) harness.stat_max[stat] = delta;
+}
+
+static void stat_pop(struct queue* queue, int stat, uint32_t count, uint64_t time)
+{
+    for (uint32_t i = 0; i < count && queue->head != queue->tail; i++) {
+        stat_record(stat, time - queue->time[queue->head++ % QUEUE_SIZE]);
+    }
+}
+
+static uint64_t stat_percentile(int stat, uint32_t permille)
+{
+    uint64_t count = 0, seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+        count += harness.histogram[stat][bucket];
+    }
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS && count != 0; bucket++) {
+        seen += harness.histogram[stat][bucket];
+        if (seen * 1000 >= count * permille) return bucket == 0 ? 1 : 1ull << bucket;
+    }
+    return 0;
+}
+
+static void resource_destroy(struct wl_client* client, struct wl_resource* resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void resource_unlink(struct wl_resource* resource)
+{
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void pointer_enter(struct wl_resource* resource)
+{
+    struct surface* surface = harness.focus;
+    wl_pointer_send_enter(resource, wl_display_next_serial(harness.wl_display), surface->resource, wl_fixed_from_int(8), wl_fixed_from_int(surface->layer->height / 2));
+    if (wl_resource_get_version(resource) >= WL_POINTER_FRAME_SINCE_VERSION) wl_pointer_send_frame(resource);
+}
+
+static void pointer_focus()
+{
+    if (harness.focus != NULL) return;
+    struct surface* surface;
+    wl_list_for_each(surface, &harness.surface, link)
+    {
+        if (surface->layer != NULL && surface->layer->configured && surface->current != NULL) {
+            harness.focus = surface;
+            break;
+        }
+    }
+    if (harness.focus == NULL) return;
+
+    struct wl_resource* resource;
+    wl_resource_for_each(resource, &harness.pointer)
+    {
+        pointer_enter(resource);
+    }
+}
+
+static void layer_configure(struct layer* layer)
+{
+    uint32_t width = layer->width != 0 ? layer->width : layer->output->width;
+    zwlr_layer_surface_v1_send_configure(layer->resource, wl_display_next_serial(harness.wl_display), width, layer->height);
+    layer->configured = true;
+    harness.configure_count++;
+}
+
+static void wl_region_handle_add(struct wl_client* client, struct wl_resource* resource, int32_t x, int32_t y, int32_t width, int32_t height) { }
+static void wl_region_handle_subtract(struct wl_client* client, struct wl_resource* resource, int32_t x, int32_t y, int32_t width, int32_t height) { }
+
+static const struct wl_region_interface wl_region_implementation = {
+    .destroy = resource_destroy,
+    .add = wl_region_handle_add,
+    .subtract = wl_region_handle_subtract,
+};
+
+static void wl_surface_handle_attach(struct wl_client* client, struct wl_resource* resource, struct wl_resource* buffer, int32_t x, int32_t y)
+{
+    struct surface* surface = wl_resource_get_user_data(resource);
+    surface->pending = buffer != NULL ? wl_resource_get_user_data(buffer) : NULL;
+    surface->attached = true;
+}
+
+static void wl_surface_handle_damage(struct wl_client* client, struct wl_resource* resource, int32_t x, int32_t y, int32_t width, int32_t height) { }
+
+static void wl_surface_handle_frame(struct wl_client* client, struct wl_resource* resource, uint32_t callback)
+{
+    struct surface* surface = wl_resource_get_user_data(resource);
+    struct wl_resource* callback_resource = wl_resource_create(client, &wl_callback_interface, 1, callback);
+    if (callback_resource == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(callback_resource, NULL, NULL, resource_unlink);
+    wl_list_insert(surface->frame_pending.prev, wl_resource_get_link(callback_resource));
+}
+
+static void wl_surface_handle_set_opaque_region(struct wl_client* client, struct wl_resource* resource, struct wl_resource* region) { }
+static void wl_surface_handle_set_input_region(struct wl_client* client, struct wl_resource* resource, struct wl_resource* region) { }
+
+// a replaced buffer is released on the first refresh after the delay, a negative delay holds it.
+static void wl_surface_handle_commit(struct wl_client* client, struct wl_resource* resource)
+{
+    struct surface* surface = wl_resource_get_user_data(resource);
+    uint64_t time = now();
+    harness.commit_count++;
+
+    bool content = false;
+    if (surface->attached) {
+        struct buffer* old = surface->current;
+        surface->current = surface->pending;
+        surface->pending = NULL;
+        surface->attached = false;
+        if (old != NULL && old != surface->current && harness.release_delay >= 0) {
+            old->release_time = time + harness.release_delay * 1000000ull;
+        }
+        if (surface->current != NULL) surface->current->release_time = 0;
+        if (surface->current != NULL && !surface->current->busy) {
+            surface->current->busy = true;
+            if (++harness.buffer_held > harness.buffer_held_max) harness.buffer_held_max = harness.buffer_held;
+        }
+        content = surface->current != NULL;
+    }
+
+    wl_list_insert_list(surface->frame.prev, &surface->frame_pending);
+    wl_list_init(&surface->frame_pending);
+    struct wl_resource *feedback, *feedback_tmp;
+    wl_resource_for_each_safe(feedback, feedback_tmp, &surface->feedback)
+    {
+        wp_presentation_feedback_send_discarded(feedback);
+        wl_resource_destroy(feedback);
+        harness.discard_count++;
+    }
+    wl_list_insert_list(&surface->feedback, &surface->feedback_pending);
+    wl_list_init(&surface->feedback_pending);
+
+    struct layer* layer = surface->layer;
+    if (layer == NULL) return;
+    if (!layer->configured) {
+        if (layer->output != NULL) layer_configure(layer);
+        return;
+    }
+    if (!content) return;
+
+    // the commit shows the newest line at best, so it is credited to the oldest line not shown yet.
+    struct queue* queue = &harness.line;
+    if (queue->head != queue->tail) {
+        stat_record(STAT_LINE, time - queue->time[queue->head % QUEUE_SIZE]);
+        harness.line_merge += queue->tail - queue->head - 1;
+        queue->head = queue->tail;
+    }
+    pointer_focus();
+}
+
+static void wl_surface_handle_set_buffer_transform(struct wl_client* client, struct wl_resource* resource, int32_t transform) { }
+static void wl_surface_handle_set_buffer_scale(struct wl_client* client, struct wl_resource* resource, int32_t scale) { }
+
+static const struct wl_surface_interface wl_surface_implementation = {
+    .destroy = resource_destroy,
+    .attach = wl_surface_handle_attach,
+    .damage = wl_surface_handle_damage,
+    .frame = wl_surface_handle_frame,
+    .set_opaque_region = wl_surface_handle_set_opaque_region,
+    .set_input_region = wl_surface_handle_set_input_region,
+    .commit = wl_surface_handle_commit,
+    .set_buffer_transform = wl_surface_handle_set_buffer_transform,
+    .set_buffer_scale = wl_surface_handle_set_buffer_scale,
+    .damage_buffer = wl_surface_handle_damage,
+};
+
+static void surface_destroy(struct wl_resource* resource)
+{
+    struct surface* surface = wl_resource_get_user_data(resource);
+    struct wl_resource *each, *each_tmp;
+    wl_resource_for_each_safe(each, each_tmp, &surface->frame_pending)
+    {
+        wl_resource_destroy(each);
+    }
+    wl_resource_for_each_safe(each, each_tmp, &surface->frame)
+    {
+        wl_resource_destroy(each);
+    }
+    wl_resource_for_each_safe(each, each_tmp, &surface->feedback_pending)
+    {
+        wp_presentation_feedback_send_discarded(each);
+        wl_resource_destroy(each);
+    }
+    wl_resource_for_each_safe(each, each_tmp, &surface->feedback)
+    {
+        wp_presentation_feedback_send_discarded(each);
+        wl_resource_destroy(each);
+    }
+    if (surface->current != NULL) surface->current->release_time = now();
+    if (surface->layer != NULL) surface->layer->surface = NULL;
+    if (surface->fractional != NULL) wl_resource_set_user_data(surface->fractional, NULL);
+    if (harness.focus == surface) harness.focus = NULL;
+    wl_list_remove(&surface->link);
+    free(surface);
+}
+
+static void wl_compositor_handle_create_surface(struct wl_client* client, struct wl_resource* resource, uint32_t id)
+{
+    struct surface* surface = calloc(1, sizeof(struct surface));
+    surface->resource = wl_resource_create(client, &wl_surface_interface, wl_resource_get_version(resource), id);
+    if (surface->resource == NULL) {
+        free(surface);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_list_init(&surface->frame_pending);
+    wl_list_init(&surface->frame);
+    wl_list_init(&surface->feedback_pending);
+    wl_list_init(&surface->feedback);
+    wl_resource_set_implementation(surface->resource, &wl_surface_implementation, surface, surface_destroy);
+    wl_list_insert(&harness.surface, &surface->link);
+}
+
+static void wl_compositor_handle_create_region(struct wl_client* client, struct wl_resource* resource, uint32_t id)
+{
+    struct wl_resource* region = wl_resource_create(client, &wl_region_interface, wl_resource_get_version(resource), id);
+    if (region == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(region, &wl_region_implementation, NULL, NULL);
+}
+
+static const struct wl_compositor_interface wl_compositor_implementation = {
+    .create_surface = wl_compositor_handle_create_surface,
+    .create_region = wl_compositor_handle_create_region,
+};
+
+static void wl_compositor_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+    struct wl_resource* resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+    wl_resource_set_implementation(resource, &wl_compositor_implementation, NULL, NULL);
+}
+
+static const struct wl_buffer_interface wl_buffer_implementation = {
+    .destroy = resource_destroy,
+};
+
+static void buffer_destroy(struct wl_resource* resource)
+{
+    struct buffer* buffer = wl_resource_get_user_data(resource);
+    struct surface* surface;
+    wl_list_for_each(surface, &harness.surface, link)
+    {
+        if (surface->pending == buffer) surface->pending = NULL;
+        if (surface->current == buffer) surface->current = NULL;
+    }
+    if (buffer->busy) harness.buffer_held--;
+    harness.buffer_destroy++;
+    wl_list_remove(&buffer->link);
+    free(buffer);
+}
+
+static void wl_shm_pool_handle_create_buffer(struct wl_client* client, struct wl_resource* resource, uint32_t id, int32_t offset, int32_t width, int32_t height, int32_t stride, uint32_t format)
+{
+    int32_t* size = wl_resource_get_user_data(resource);
+    if (format != WL_SHM_FORMAT_ARGB8888 && format != WL_SHM_FORMAT_XRGB8888) {
+        wl_resource_post_error(resource, WL_SHM_ERROR_INVALID_FORMAT, "invalid format 0x%x", format);
+        return;
+    } else if (offset < 0 || width <= 0 || height <= 0 || stride < width * 4 || offset + (int64_t)stride * height > *size) {
+        wl_resource_post_error(resource, WL_SHM_ERROR_INVALID_STRIDE, "invalid buffer %dx%d stride %d offset %d", width, height, stride, offset);
+        return;
+    }
+
+    struct buffer* buffer = calloc(1, sizeof(struct buffer));
+    buffer->resource = wl_resource_create(client, &wl_buffer_interface, 1, id);
+    if (buffer->resource == NULL) {
+        free(buffer);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    buffer->width = width;
+    buffer->height = height;
+    wl_resource_set_implementation(buffer->resource, &wl_buffer_implementation, buffer, buffer_destroy);
+    wl_list_insert(&harness.buffer, &buffer->link);
+    harness.buffer_create++;
+}
+
+static void wl_shm_pool_handle_resize(struct wl_client* client, struct wl_resource* resource, int32_t size)
+{
+    int32_t* pool_size = wl_resource_get_user_data(resource);
+    if (size < *pool_size) {
+        wl_resource_post_error(resource, WL_SHM_ERROR_INVALID_STRIDE, "shrinking pool invalid");
+        return;
+    }
+    *pool_size = size;
+    harness.pool_resize++;
+}
+
+static const struct wl_shm_pool_interface wl_shm_pool_implementation = {
+    .create_buffer = wl_shm_pool_handle_create_buffer,
+    .destroy = resource_destroy,
+    .resize = wl_shm_pool_handle_resize,
+};
+
+static void pool_destroy(struct wl_resource* resource)
+{
+    free(wl_resource_get_user_data(resource));
+}
+
+static void wl_shm_handle_create_pool(struct wl_client* client, struct wl_resource* resource, uint32_t id, int32_t fd, int32_t size)
+{
+    close(fd);
+    if (size <= 0) {
+        wl_resource_post_error(resource, WL_SHM_ERROR_INVALID_STRIDE, "invalid size (%d)", size);
+        return;
+    }
+    int32_t* pool_size = malloc(sizeof(int32_t));
+    *pool_size = size;
+    struct wl_resource* pool = wl_resource_create(client, &wl_shm_pool_interface, wl_resource_get_version(resource), id);
+    if (pool == NULL) {
+        free(pool_size);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(pool, &wl_shm_pool_implementation, pool_size, pool_destroy);
+    harness.pool_create++;
+}
+
+static const struct wl_shm_interface wl_shm_implementation = {
+    .create_pool = wl_shm_handle_create_pool,
+    .release = resource_destroy,
+};
+
+static void wl_shm_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+    struct wl_resource* resource = wl_resource_create(client, &wl_shm_interface, version, id);
+    wl_resource_set_implementation(resource, &wl_shm_implementation, NULL, NULL);
+    wl_shm_send_format(resource, WL_SHM_FORMAT_ARGB8888);
+    wl_shm_send_format(resource, WL_SHM_FORMAT_XRGB8888);
+}
+
+static const struct wl_output_interface wl_output_implementation = {
+    .release = resource_destroy,
+};
+
+static void wl_output_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+    struct output* output = data;
+    struct wl_resource* resource = wl_resource_create(client, &wl_output_interface, version, id);
+    wl_resource_set_implementation(resource, &wl_output_implementation, output, resource_unlink);
+    wl_list_insert(&output->resource, wl_resource_get_link(resource));
+    wl_output_send_geometry(resource, 0, 0, 0, 0, WL_OUTPUT_SUBPIXEL_UNKNOWN, "pipebar", "harness", WL_OUTPUT_TRANSFORM_NORMAL);
+    wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT, output->width * output->scale / 120, output->height * output->scale / 120, harness.refresh * 1000);
+    if (version >= WL_OUTPUT_SCALE_SINCE_VERSION) wl_output_send_scale(resource, (output->scale + 119) / 120);
+    if (version >= WL_OUTPUT_NAME_SINCE_VERSION) wl_output_send_name(resource, output->name);
+    if (version >= WL_OUTPUT_DESCRIPTION_SINCE_VERSION) wl_output_send_description(resource, output->name);
+    if (version >= WL_OUTPUT_DONE_SINCE_VERSION) wl_output_send_done(resource);
+}
+
+static void output_add(struct output* output)
+{
+    if (output->wl_global_removed != NULL) {
+        wl_global_destroy(output->wl_global_removed);
+        output->wl_global_removed = NULL;
+    }
+    output->wl_global = wl_global_create(harness.wl_display, &wl_output_interface, 4, output, wl_output_bind);
+}
+
+// the global is only destroyed when the output comes back, so that late binds do not fail.
+static void output_remove(struct output* output)
+{
+    wl_global_remove(output->wl_global);
+    output->wl_global_removed = output->wl_global;
+    output->wl_global = NULL;
+    struct surface* surface;
+    wl_list_for_each(surface, &harness.surface, link)
+    {
+        if (surface->layer != NULL && surface->layer->output == output) {
+            zwlr_layer_surface_v1_send_closed(surface->layer->resource);
+            surface->layer->output = NULL;
+        }
+    }
+}
+
+static void wl_pointer_handle_set_cursor(struct wl_client* client, struct wl_resource* resource, uint32_t serial, struct wl_resource* surface, int32_t hotspot_x, int32_t hotspot_y) { }
+
+static const struct wl_pointer_interface wl_pointer_implementation = {
+    .set_cursor = wl_pointer_handle_set_cursor,
+    .release = resource_destroy,
+};
+
+static void wl_seat_handle_get_pointer(struct wl_client* client, struct wl_resource* resource, uint32_t id)
+{
+    struct wl_resource* pointer = wl_resource_create(client, &wl_pointer_interface, wl_resource_get_version(resource), id);
+    if (pointer == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(pointer, &wl_pointer_implementation, NULL, resource_unlink);
+    wl_list_insert(&harness.pointer, wl_resource_get_link(pointer));
+    if (harness.focus != NULL) pointer_enter(pointer);
+}
+
+static const struct wl_seat_interface wl_seat_implementation = {
+    .get_pointer = wl_seat_handle_get_pointer,
+    .release = resource_destroy,
+};
+
+static void wl_seat_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+    struct wl_resource* resource = wl_resource_create(client, &wl_seat_interface, version, id);
+    wl_resource_set_implementation(resource, &wl_seat_implementation, NULL, NULL);
+    wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_POINTER);
+    if (version >= WL_SEAT_NAME_SINCE_VERSION) wl_seat_send_name(resource, "seat0");
+}
+
+static void zwlr_layer_surface_handle_set_size(struct wl_client* client, struct wl_resource* resource, uint32_t width, uint32_t height)
+{
+    struct layer* layer = wl_resource_get_user_data(resource);
+    layer->width = width;
+    layer->height = height;
+}
+
+static void zwlr_layer_surface_handle_set_anchor(struct wl_client* client, struct wl_resource* resource, uint32_t anchor) { }
+static void zwlr_layer_surface_handle_set_exclusive_zone(struct wl_client* client, struct wl_resource* resource, int32_t zone) { }
+static void zwlr_layer_surface_handle_set_margin(struct wl_client* client, struct wl_resource* resource, int32_t top, int32_t right, int32_t bottom, int32_t left) { }
+static void zwlr_layer_surface_handle_set_keyboard_interactivity(struct wl_client* client, struct wl_resource* resource, uint32_t keyboard_interactivity) { }
+static void zwlr_layer_surface_handle_get_popup(struct wl_client* client, struct wl_resource* resource, struct wl_resource* popup) { }
+static void zwlr_layer_surface_handle_ack_configure(struct wl_client* client, struct wl_resource* resource, uint32_t serial) { }
+static void zwlr_layer_surface_handle_set_layer(struct wl_client* client, struct wl_resource* resource, uint32_t layer) { }
+
+static const struct zwlr_layer_surface_v1_interface zwlr_layer_surface_implementation = {
+    .set_size = zwlr_layer_surface_handle_set_size,
+    .set_anchor = zwlr_layer_surface_handle_set_anchor,
+    .set_exclusive_zone = zwlr_layer_surface_handle_set_exclusive_zone,
+    .set_margin = zwlr_layer_surface_handle_set_margin,
+    .set_keyboard_interactivity = zwlr_layer_surface_handle_set_keyboard_interactivity,
+    .get_popup = zwlr_layer_surface_handle_get_popup,
+    .ack_configure = zwlr_layer_surface_handle_ack_configure,
+    .destroy = resource_destroy,
+    .set_layer = zwlr_layer_surface_handle_set_layer,
+};
+
+static void layer_destroy(struct wl_resource* resource)
+{
+    struct layer* layer = wl_resource_get_user_data(resource);
+    if (layer->surface != NULL) layer->surface->layer = NULL;
+    if (harness.focus != NULL && harness.focus == layer->surface) harness.focus = NULL;
+    free(layer);
+}
+
+static void zwlr_layer_shell_handle_get_layer_surface(struct wl_client* client, struct wl_resource* resource, uint32_t id, struct wl_resource* surface_resource, struct wl_resource* output_resource, uint32_t layer_idx, const char* namespace)
+{
+    struct layer* layer = calloc(1, sizeof(struct layer));
+    layer->resource = wl_resource_create(client, &zwlr_layer_surface_v1_interface, wl_resource_get_version(resource), id);
+    if (layer->resource == NULL) {
+        free(layer);
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(layer->resource, &zwlr_layer_surface_implementation, layer, layer_destroy);
+    layer->surface = wl_resource_get_user_data(surface_resource);
+    layer->surface->layer = layer;
+    if (output_resource != NULL) {
+        layer->output = wl_resource_get_user_data(output_resource);
+    } else {
+        layer->output = *(struct output**)harness.output.data;
+    }
+    if (layer->output->wl_global == NULL) {
+        zwlr_layer_surface_v1_send_closed(layer->resource);
+        layer->output = NULL;
+    } else if (layer->surface->fractional != NULL) {
+        wp_fractional_scale_v1_send_preferred_scale(layer->surface->fractional, layer->output->scale);
+    }
+}
+
+static const struct zwlr_layer_shell_v1_interface zwlr_layer_shell_implementation = {
+    .get_layer_surface = zwlr_layer_shell_handle_get_layer_surface,
+    .destroy = resource_destroy,
+};
+
+static void zwlr_layer_shell_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+    struct wl_resource* resource = wl_resource_create(client, &zwlr_layer_shell_v1_interface, version, id);
+    wl_resource_set_implementation(resource, &zwlr_layer_shell_implementation, NULL, NULL);
+}
+
+static const struct wp_fractional_scale_v1_interface wp_fractional_scale_implementation = {
+    .destroy = resource_destroy,
+};
+
+static void fractional_destroy(struct wl_resource* resource)
+{
+    struct surface* surface = wl_resource_get_user_data(resource);
+    if (surface != NULL) surface->fractional = NULL;
+}
+
+static void wp_fractional_scale_manager_handle_get_fractional_scale(struct wl_client* client, struct wl_resource* resource, uint32_t id, struct wl_resource* surface_resource)
+{
+    struct surface* surface = wl_resource_get_user_data(surface_resource);
+    struct wl_resource* fractional = wl_resource_create(client, &wp_fractional_scale_v1_interface, 1, id);
+    if (fractional == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(fractional, &wp_fractional_scale_implementation, surface, fractional_destroy);
+    surface->fractional = fractional;
+    if (surface->layer != NULL && surface->layer->output != NULL) {
+        wp_fractional_scale_v1_send_preferred_scale(fractional, surface->layer->output->scale);
+    }
+}
+
+static const struct wp_fractional_scale_manager_v1_interface wp_fractional_scale_manager_implementation = {
+    .destroy = resource_destroy,
+    .get_fractional_scale = wp_fractional_scale_manager_handle_get_fractional_scale,
+};
+
+static void wp_fractional_scale_manager_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+    struct wl_resource* resource = wl_resource_create(client, &wp_fractional_scale_manager_v1_interface, version, id);
+    wl_resource_set_implementation(resource, &wp_fractional_scale_manager_implementation, NULL, NULL);
+}
+
+static void wp_viewport_handle_set_source(struct wl_client* client, struct wl_resource* resource, wl_fixed_t x, wl_fixed_t y, wl_fixed_t width, wl_fixed_t height) { }
+static void wp_viewport_handle_set_destination(struct wl_client* client, struct wl_resource* resource, int32_t width, int32_t height) { }
+
+static const struct wp_viewport_interface wp_viewport_implementation = {
+    .destroy = resource_destroy,
+    .set_source = wp_viewport_handle_set_source,
+    .set_destination = wp_viewport_handle_set_destination,
+};
+
+static void wp_viewporter_handle_get_viewport(struct wl_client* client, struct wl_resource* resource, uint32_t id, struct wl_resource* surface)
+{
+    struct wl_resource* viewport = wl_resource_create(client, &wp_viewport_interface, 1, id);
+    if (viewport == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(viewport, &wp_viewport_implementation, NULL, NULL);
+}
+
+static const struct wp_viewporter_interface wp_viewporter_implementation = {
+    .destroy = resource_destroy,
+    .get_viewport = wp_viewporter_handle_get_viewport,
+};
+
+static void wp_viewporter_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+    struct wl_resource* resource = wl_resource_create(client, &wp_viewporter_interface, version, id);
+    wl_resource_set_implementation(resource, &wp_viewporter_implementation, NULL, NULL);
+}
+
+static void wp_presentation_handle_feedback(struct wl_client* client, struct wl_resource* resource, struct wl_resource* surface_resource, uint32_t callback)
+{
+    struct surface* surface = wl_resource_get_user_data(surface_resource);
+    struct wl_resource* feedback = wl_resource_create(client, &wp_presentation_feedback_interface, 1, callback);
+    if (feedback == NULL) {
+        wl_client_post_no_memory(client);
+        return;
+    }
+    wl_resource_set_implementation(feedback, NULL, NULL, resource_unlink);
+    wl_list_insert(surface->feedback_pending.prev, wl_resource_get_link(feedback));
+}
+
+static const struct wp_presentation_interface wp_presentation_implementation = {
+    .destroy = resource_destroy,
+    .feedback = wp_presentation_handle_feedback,
+};
+
+static void wp_presentation_bind(struct wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+    struct wl_resource* resource = wl_resource_create(client, &wp_presentation_interface, version, id);
+    wl_resource_set_implementation(resource, &wp_presentation_implementation, NULL, NULL);
+    wp_presentation_send_clock_id(resource, CLOCK_MONOTONIC);
+}
+
+static int refresh_tick(void* data)
+{
+    wl_event_source_timer_update(harness.refresh_timer, 1000 / harness.refresh);
+    uint64_t time = now();
+    uint64_t sec = time / 1000000000ull;
+    harness.seq++;
+
+    struct surface* surface;
+    wl_list_for_each(surface, &harness.surface, link)
+    {
+        struct wl_resource *resource, *resource_tmp;
+        wl_resource_for_each_safe(resource, resource_tmp, &surface->frame)
+        {
+            wl_callback_send_done(resource, time / 1000000);
+            wl_resource_destroy(resource);
+            harness.frame_count++;
+        }
+        wl_resource_for_each_safe(resource, resource_tmp, &surface->feedback)
+        {
+            wp_presentation_feedback_send_presented(resource, sec >> 32, sec & 0xffffffff, time % 1000000000ull, 1000000000 / harness.refresh,
+                harness.seq >> 32, harness.seq & 0xffffffff, WP_PRESENTATION_FEEDBACK_KIND_VSYNC);
+            wl_resource_destroy(resource);
+            harness.present_count++;
+        }
+    }
+
+    struct buffer* buffer;
+    wl_list_for_each(buffer, &harness.buffer, link)
+    {
+        if (buffer->release_time == 0 || buffer->release_time > time) continue;
+        buffer->release_time = 0;
+        if (buffer->busy) {
+            buffer->busy = false;
+            harness.buffer_held--;
+            wl_buffer_send_release(buffer->resource);
+        }
+    }
+    return 0;
+}
+
+static int line_tick(void* data)
+{
+    wl_event_source_timer_update(harness.line_timer, harness.line_interval);
+    char line[256];
+    int len = snprintf(line, sizeof(line), "\x1f" "1click {}\x1f\x1f" "4scroll {}\x1f line %u \x1f" "4\x1f\x1f" "1\x1f\x1f" "D\x1f%u\x1f" "D\x1fharness\n",
+        harness.line_count, harness.line_count % 60);
+    if (write(harness.stdin_fd, line, len) < 0) {
+        if (errno != EAGAIN) msg(INNER_ERROR, "failed to write to pipebar.");
+        harness.line_stall++;
+        return 0;
+    }
+    queue_push(&harness.line, now());
+    harness.line_count++;
+    return 0;
+}
+
+static int click_tick(void* data)
+{
+    wl_event_source_timer_update(harness.click_timer, harness.click_interval);
+    if (harness.focus == NULL || wl_list_empty(&harness.pointer)) return 0;
+    uint64_t time = now();
+    struct wl_resource* resource;
+    wl_resource_for_each(resource, &harness.pointer)
+    {
+        wl_pointer_send_button(resource, wl_display_next_serial(harness.wl_display), time / 1000000, BTN_LEFT, WL_POINTER_BUTTON_STATE_PRESSED);
+        if (wl_resource_get_version(resource) >= WL_POINTER_FRAME_SINCE_VERSION) wl_pointer_send_frame(resource);
+        wl_pointer_send_button(resource, wl_display_next_serial(harness.wl_display), time / 1000000, BTN_LEFT, WL_POINTER_BUTTON_STATE_RELEASED);
+        if (wl_resource_get_version(resource) >= WL_POINTER_FRAME_SINCE_VERSION) wl_pointer_send_frame(resource);
+    }
+    queue_push(&harness.click, time);
+    harness.click_count++;
+    return 0;
+}
+
+static int wheel_tick(void* data)
+{
+    wl_event_source_timer_update(harness.wheel_timer, harness.wheel_interval);
+    if (harness.focus == NULL || wl_list_empty(&harness.pointer)) return 0;
+    uint64_t time = now();
+    struct wl_resource* resource;
+    wl_resource_for_each(resource, &harness.pointer)
+    {
+        uint32_t version = wl_resource_get_version(resource);
+        if (version >= WL_POINTER_AXIS_SOURCE_SINCE_VERSION) wl_pointer_send_axis_source(resource, WL_POINTER_AXIS_SOURCE_WHEEL);
+        if (version >= WL_POINTER_AXIS_VALUE120_SINCE_VERSION) {
+            wl_pointer_send_axis_value120(resource, WL_POINTER_AXIS_VERTICAL_SCROLL, 120);
+        } else if (version >= WL_POINTER_AXIS_DISCRETE_SINCE_VERSION) {
+            wl_pointer_send_axis_discrete(resource, WL_POINTER_AXIS_VERTICAL_SCROLL, 1);
+        }
+        wl_pointer_send_axis(resource, time / 1000000, WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_int(15));
+        if (version >= WL_POINTER_FRAME_SINCE_VERSION) wl_pointer_send_frame(resource);
+    }
+    queue_push(&harness.wheel, time);
+    harness.wheel_count++;
+    return 0;
+}
+
+static int hotplug_tick(void* data)
+{
+    wl_event_source_timer_update(harness.hotplug_timer, harness.hotplug_interval);
+    struct output** output = harness.output.data;
+    output += harness.hotplug_count++ % (harness.output.size / sizeof(struct output*));
+    if ((*output)->wl_global != NULL) {
+        output_remove(*output);
+    } else {
+        output_add(*output);
+    }
+    return 0;
+}
+
+static int end_tick(void* data)
+{
+    harness.quit = true;
+    return 0;
+}
+
+static int stdout_readable(int fd, uint32_t mask, void* data)
+{
+    struct wl_array* buffer = &harness.stdout_buffer;
+    if (buffer->alloc - buffer->size < 4096) {
+        wl_array_add(buffer, 4096);
+        buffer->size -= 4096;
+    }
+    ssize_t len = read(fd, (char*)buffer->data + buffer->size, buffer->alloc - buffer->size);
+    if (len <= 0) {
+        if (len < 0 && (errno == EAGAIN || errno == EINTR)) return 0;
+        wl_event_source_remove(harness.stdout_source);
+        harness.stdout_source = NULL;
+        return 0;
+    }
+    buffer->size += len;
+
+    uint64_t time = now();
+    char* head = buffer->data;
+    for (char* tail; (tail = memchr(head, '\n', (char*)buffer->data + buffer->size - head)) != NULL; head = tail + 1) {
+        tail[0] = '\0';
+        uint32_t count;
+        if (sscanf(head, "click %u", &count) == 1) {
+            stat_pop(&harness.click, STAT_CLICK, count, time);
+        } else if (sscanf(head, "scroll %u", &count) == 1) {
+            stat_pop(&harness.wheel, STAT_WHEEL, count, time);
+        }
+        harness.action_count++;
+    }
+    buffer->size = (char*)buffer->data + buffer->size - head;
+    memmove(buffer->data, head, buffer->size);
+    return 0;
+}
+
+static int child_exited(int signal_number, void* data)
+{
+    int status;
+    if (harness.pid > 0 && waitpid(harness.pid, &status, WNOHANG) == harness.pid) {
+        harness.pid = -1;
+        harness.quit = true;
+        harness.status = RUNTIME_ERROR;
+        msg(WARNING, "pipebar exited early with status %d.", WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    }
+    return 0;
+}
+
+static void wl_client_handle_destroy(struct wl_listener* listener, void* data)
+{
+    harness.wl_client = NULL;
+    harness.quit = true;
+}
+
+static void init(int argc, char** argv)
+{
+    char default_outputs[] = "HARNESS-1";
+    char* outputs = default_outputs;
+    static char* default_command[] = { "./pipebar", NULL };
+    harness.command = default_command;
+    harness.release_delay = 0;
+    harness.refresh = 60;
+    harness.line_interval = 16;
+    harness.click_interval = 500;
+    harness.wheel_interval = 0;
+    harness.hotplug_interval = 0;
+    harness.duration = 10;
+    harness.stdin_fd = -1;
+    harness.stdout_fd = -1;
+    wl_array_init(&harness.output);
+    wl_array_init(&harness.stdout_buffer);
+    wl_list_init(&harness.surface);
+    wl_list_init(&harness.buffer);
+    wl_list_init(&harness.pointer);
+
+    for (int i = 1; i < argc; i++) {
+        uint32_t* value = NULL;
+        if (strcmp(argv[i], "--") == 0) {
+            if (i + 1 < argc) harness.command = argv + i + 1;
+            break;
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                outputs = argv[i];
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+            continue;
+        } else if (strcmp(argv[i], "-r") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                char* endptr;
+                harness.release_delay = strtol(argv[i], &endptr, 10);
+                if (*endptr != '\0') {
+                    msg(RUNTIME_ERROR, "option %s got a invalid argument: %s.", argv[i - 1], argv[i]);
+                }
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+            continue;
+        } else if (strcmp(argv[i], "-f") == 0) {
+            value = &harness.refresh;
+        } else if (strcmp(argv[i], "-i") == 0) {
+            value = &harness.line_interval;
+        } else if (strcmp(argv[i], "-c") == 0) {
+            value = &harness.click_interval;
+        } else if (strcmp(argv[i], "-w") == 0) {
+            value = &harness.wheel_interval;
+        } else if (strcmp(argv[i], "-H") == 0) {
+            value = &harness.hotplug_interval;
+        } else if (strcmp(argv[i], "-t") == 0) {
+            value = &harness.duration;
+        } else {
+            msg(RUNTIME_ERROR,
+                "pipebar-harness is a stand-in wayland compositor for pipebar.\n"
+                "It runs pipebar, feeds it lines, clicks and scrolls its bar, and measures the latencies.\n"
+                "\n"
+                "        usage           pipebar-harness [options] [-- pipebar [options]]\n"
+                "\n"
+                "Options are:\n"
+                "        -o output,...   set outputs list (HARNESS-1)\n"
+                "        -r delay        release replaced buffers after delay ms, -1 holds them (0)\n"
+                "        -f hz           set refresh rate of frame callbacks and presentation (60)\n"
+                "        -i interval     write a line to pipebar every interval ms, 0 means never (16)\n"
+                "        -c interval     click the bar every interval ms, 0 means never (500)\n"
+                "        -w interval     scroll the bar every interval ms, 0 means never (0)\n"
+                "        -H interval     remove or add an output every interval ms, 0 means never (0)\n"
+                "        -t seconds      run for seconds, then print the summary to STDOUT (10)\n"
+                "\n"
+                "output can be: (scale is in 120ths as in fractional scale, width is logical)\n"
+                "        name            scale 120, width 1920\n"
+                "        name:scale      width 1920\n"
+                "        name:scale:width\n");
+        }
+        if (++i < argc && argv[i][0] != '\0') {
+            char* endptr;
+            *value = strtoul(argv[i], &endptr, 10);
+            if (*endptr != '\0') {
+                msg(RUNTIME_ERROR, "option %s got a invalid argument: %s.", argv[i - 1], argv[i]);
+            }
+        } else {
+            msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+        }
+    }
+    if (harness.refresh == 0 || harness.duration == 0) {
+        msg(RUNTIME_ERROR, "refresh rate and duration must not be 0.");
+    }
+
+    for (char *head = outputs, *reader = outputs;; reader++) {
+        if (reader[0] != ',' && reader[0] != '\0') continue;
+        struct output* output = calloc(1, sizeof(struct output));
+        *(struct output**)wl_array_add(&harness.output, sizeof(struct output*)) = output;
+        output->scale = 120;
+        output->width = 1920;
+        output->height = 1080;
+        wl_list_init(&output->resource);
+        int name_len = 0;
+        sscanf(head, "%*[^:,]%n:%u:%u", &name_len, &output->scale, &output->width);
+        if (name_len == 0 || output->scale == 0 || output->width == 0) {
+            msg(RUNTIME_ERROR, "option -o got a invalid output: %.*s.", (int)(reader - head), head);
+        }
+        output->name = strndup(head, name_len);
+        if (reader[0] == '\0') break;
+        head = reader + 1;
+    }
+}
+
+static void setup()
+{
+    signal(SIGPIPE, SIG_IGN);
+    harness.wl_display = wl_display_create();
+    if (harness.wl_display == NULL) {
+        msg(INNER_ERROR, "failed to create wayland display.");
+    }
+    harness.wl_event_loop = wl_display_get_event_loop(harness.wl_display);
+
+    wl_global_create(harness.wl_display, &wl_compositor_interface, 4, NULL, wl_compositor_bind);
+    wl_global_create(harness.wl_display, &wl_shm_interface, 2, NULL, wl_shm_bind);
+    wl_global_create(harness.wl_display, &wl_seat_interface, 8, NULL, wl_seat_bind);
+    wl_global_create(harness.wl_display, &zwlr_layer_shell_v1_interface, 3, NULL, zwlr_layer_shell_bind);
+    wl_global_create(harness.wl_display, &wp_fractional_scale_manager_v1_interface, 1, NULL, wp_fractional_scale_manager_bind);
+    wl_global_create(harness.wl_display, &wp_viewporter_interface, 1, NULL, wp_viewporter_bind);
+    wl_global_create(harness.wl_display, &wp_presentation_interface, 1, NULL, wp_presentation_bind);
+    struct output** output;
+    wl_array_for_each(output, &harness.output)
+    {
+        output_add(*output);
+    }
+
+    wl_event_loop_add_signal(harness.wl_event_loop, SIGCHLD, child_exited, NULL);
+
+    int wl_fds[2], stdin_fds[2], stdout_fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, wl_fds) < 0 || pipe2(stdin_fds, O_CLOEXEC) < 0 || pipe2(stdout_fds, O_CLOEXEC) < 0) {
+        msg(INNER_ERROR, "failed to create pipebar connections.");
+    }
+    harness.pid = fork();
+    if (harness.pid < 0) {
+        msg(INNER_ERROR, "failed to fork.");
+    } else if (harness.pid == 0) {
+        char wl_socket[16];
+        sprintf(wl_socket, "%d", dup(wl_fds[1]));
+        setenv("WAYLAND_SOCKET", wl_socket, 1);
+        dup2(stdin_fds[0], STDIN_FILENO);
+        dup2(stdout_fds[1], STDOUT_FILENO);
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigprocmask(SIG_SETMASK, &mask, NULL);
+        execvp(harness.command[0], harness.command);
+        _exit(127);
+    }
+    close(wl_fds[1]);
+    close(stdin_fds[0]);
+    close(stdout_fds[1]);
+
+    harness.wl_client = wl_client_create(harness.wl_display, wl_fds[0]);
+    if (harness.wl_client == NULL) {
+        msg(INNER_ERROR, "failed to create wayland client.");
+    }
+    harness.wl_client_destroy.notify = wl_client_handle_destroy;
+    wl_client_add_destroy_listener(harness.wl_client, &harness.wl_client_destroy);
+
+    harness.stdin_fd = stdin_fds[1];
+    harness.stdout_fd = stdout_fds[0];
+    fcntl(harness.stdin_fd, F_SETFL, fcntl(harness.stdin_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(harness.stdout_fd, F_SETFL, fcntl(harness.stdout_fd, F_GETFL) | O_NONBLOCK);
+    harness.stdout_source = wl_event_loop_add_fd(harness.wl_event_loop, harness.stdout_fd, WL_EVENT_READABLE, stdout_readable, NULL);
+
+    harness.refresh_timer = wl_event_loop_add_timer(harness.wl_event_loop, refresh_tick, NULL);
+    wl_event_source_timer_update(harness.refresh_timer, 1000 / harness.refresh);
+    harness.end_timer = wl_event_loop_add_timer(harness.wl_event_loop, end_tick, NULL);
+    wl_event_source_timer_update(harness.end_timer, harness.duration * 1000);
+    if (harness.line_interval != 0) {
+        harness.line_timer = wl_event_loop_add_timer(harness.wl_event_loop, line_tick, NULL);
+        wl_event_source_timer_update(harness.line_timer, harness.line_interval);
+    }
+    if (harness.click_interval != 0) {
+        harness.click_timer = wl_event_loop_add_timer(harness.wl_event_loop, click_tick, NULL);
+        wl_event_source_timer_update(harness.click_timer, harness.click_interval);
+    }
+    if (harness.wheel_interval != 0) {
+        harness.wheel_timer = wl_event_loop_add_timer(harness.wl_event_loop, wheel_tick, NULL);
+        wl_event_source_timer_update(harness.wheel_timer, harness.wheel_interval);
+    }
+    if (harness.hotplug_interval != 0) {
+        harness.hotplug_timer = wl_event_loop_add_timer(harness.wl_event_loop, hotplug_tick, NULL);
+        wl_event_source_timer_update(harness.hotplug_timer, harness.hotplug_interval);
+    }
+}
+
+static void summary()
+{
+    static const char* stat_name[STAT_SIZE] = { "line_to_commit", "click_to_stdout", "scroll_to_stdout" };
+    printf("{");
+    for (int stat = 0; stat < STAT_SIZE; stat++) {
+        uint64_t count = 0;
+        for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+            count += harness.histogram[stat][bucket];
+        }
+        printf("\"%s\":{\"count\":%" PRIu64 ",\"p50_us\":%" PRIu64 ",\"p90_us\":%" PRIu64 ",\"p99_us\":%" PRIu64 ",\"max_us\":%" PRIu64 "},", stat_name[stat], count,
+            stat_percentile(stat, 500), stat_percentile(stat, 900), stat_percentile(stat, 990), harness.stat_max[stat] / 1000);
+    }
+    printf("\"lines\":%u,\"lines_stalled\":%u,\"lines_merged\":%u,\"clicks\":%u,\"scrolls\":%u,\"actions\":%u,"
+           "\"commits\":%u,\"configures\":%u,\"frames\":%u,\"presented\":%u,\"discarded\":%u,"
+           "\"pools\":%u,\"pool_resizes\":%u,\"buffers_created\":%u,\"buffers_destroyed\":%u,\"buffers_held_max\":%u,\"hotplugs\":%u}\n",
+        harness.line_count, harness.line_stall, harness.line_merge, harness.click_count, harness.wheel_count, harness.action_count,
+        harness.commit_count, harness.configure_count, harness.frame_count, harness.present_count, harness.discard_count,
+        harness.pool_create, harness.pool_resize, harness.buffer_create, harness.buffer_destroy, harness.buffer_held_max, harness.hotplug_count);
+}
+
+int main(int argc, char** argv)
+{
+    init(argc, argv);
+    setup();
+
+    while (!harness.quit) {
+        wl_display_flush_clients(harness.wl_display);
+        if (wl_event_loop_dispatch(harness.wl_event_loop, -1) < 0 && errno != EINTR) {
+            msg(INNER_ERROR, "failed to dispatch wayland event loop.");
+        }
+    }
+
+    summary();
+    msg(harness.status, NULL);
+    return harness.status;
+}
@@ -1,25 +1,51 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <endian.h>
 #include <errno.h>
 #include <fcft/fcft.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
 #include <linux/input-event-codes.h>
 #include <pixman.h>
+#include <pthread.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/mman.h>
 #include <sys/poll.h>
 #include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <wayland-client.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "protocols/fractional-scale.h"
+#include "protocols/presentation-time.h"
 #include "protocols/viewporter.h"
 #include "protocols/wlr-layer-shell.h"
 
+#define INPUT_CHUNK 65536
+#define RUN_CACHE_SIZE 256
+#define DAMAGE_SIZE 4
+#define OUTPUT_SIZE 31
+#define FONT_CACHE_SCALES 2
+#define BLOCK_BACKOFF_MIN 1
+#define BLOCK_BACKOFF_MAX 64
+#define ACTION_QUEUE_SIZE 65536
+#define FRAME_SIZE_MAX 1048576
+#define TRACE_BUCKETS 32
+
 enum {
     PART_LEFT,
     PART_CENTER,
@@ -27,27 +53,84 @@ enum {
     PART_SIZE,
 };
 
+// the TRACE_LINE row of the histogram holds the total latency.
+enum {
+    TRACE_LINE,
+    TRACE_PARSE,
+    TRACE_SHAPE,
+    TRACE_COMPOSITE,
+    TRACE_COMMIT,
+    TRACE_PRESENT,
+    TRACE_SIZE,
+};
+
+struct run {
+    struct fcft_font* font;
+    uint64_t hash;
+    struct wl_array codepoint;
+    struct fcft_text_run* text_run;
+    uint32_t width;
+    int refs;
+    struct wl_list link;
+};
+
+static void run_put(struct run* run)
+{
+    if (run != NULL) run->refs--;
+}
+
+struct font {
+    const char* name;
+    uint32_t dpi;
+    struct fcft_font* fcft_font;
+    int refs;
+    struct wl_list link;
+};
+
+static void font_put(struct font* font)
+{
+    if (font != NULL) font->refs--;
+}
+
 struct block {
     struct entry* entry;
     uint32_t x, y, width, height, base;
     pixman_color_t *bg, *fg;
     struct fcft_font* font;
-    struct fcft_text_run* run;
+    struct run* run;
     struct wl_list link;
     struct bar* bar;
 };
 
 static void block_destroy(struct block* block)
 {
-    fcft_text_run_destroy(block->run);
+    run_put(block->run);
     wl_list_remove(&block->link);
     free(block);
 }
 
+struct rect {
+    int32_t x, y, width, height;
+    uint64_t hash;
+    uint32_t style;
+};
+
+static bool rect_equal(const struct rect* a, const struct rect* b)
+{
+    return a->x == b->x && a->y == b->y && a->width == b->width && a->height == b->height
+        && a->hash == b->hash && a->style == b->style;
+}
+
+static void damage_rect(pixman_region32_t* damage, const struct rect* rect)
+{
+    pixman_region32_union_rect(damage, damage, rect->x - rect->height, rect->y, rect->width + 2 * rect->height, rect->height);
+}
+
 struct canvas {
     struct wl_buffer* wl_buffer;
     uint32_t width, height;
-    void* mmapped;
+    uint64_t frame;
+    size_t offset;
     pixman_image_t* image;
     bool busy;
     struct wl_list link;
@@ -58,13 +141,13 @@ static void canvas_destroy(struct canvas* canvas)
 {
     wl_list_remove(&canvas->link);
     pixman_image_unref(canvas->image);
-    munmap(canvas->mmapped, canvas->width * canvas->height * 4);
-    wl_buffer_destroy(canvas->wl_buffer);
+    if (canvas->wl_buffer != NULL) wl_buffer_destroy(canvas->wl_buffer);
     free(canvas);
 }
 
 struct bar {
     char name[16];
+    uint32_t output;
     struct wl_output* wl_output;
     uint32_t wl_output_name;
     struct wl_surface* wl_surface;
@@ -74,18 +157,35 @@ struct bar {
     uint32_t width, scale, canvas_width, canvas_height;
     struct wl_array font;
     struct wl_list part[PART_SIZE + 1];
+    struct wl_array layout[PART_SIZE];
+    pixman_region32_t damage[DAMAGE_SIZE];
+    pixman_region32_t repaint;
+    struct canvas* pending;
+    struct hitmap* hitmap;
+    uint64_t frame;
+    pixman_glyph_cache_t* glyph_cache;
+    struct wl_array glyph;
+    int pool_fd;
+    void* pool_data;
+    size_t pool_size;
+    struct wl_shm_pool* wl_shm_pool;
+    uint32_t pool_grow, pool_starve;
     struct wl_list canvas;
     struct wl_list link;
+    struct wl_callback* wl_callback;
+    uint64_t time;
+    uint64_t trace[TRACE_SIZE];
+    uint32_t dirty;
     bool managed;
     bool redraw;
 };
 
 static void bar_destroy(struct bar* bar)
 {
-    struct fcft_font** font;
+    struct font** font;
     wl_array_for_each(font, &bar->font)
     {
-        fcft_destroy(*font);
+        font_put(*font);
     }
     wl_array_release(&bar->font);
     for (int part_idx = PART_LEFT; part_idx <= PART_SIZE; part_idx++) {
@@ -95,41 +195,37 @@ static void bar_destroy(struct bar* bar)
             block_destroy(block);
         }
     }
+    for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
+        wl_array_release(&bar->layout[part_idx]);
+    }
+    for (int i = 0; i < DAMAGE_SIZE; i++) {
+        pixman_region32_fini(&bar->damage[i]);
+    }
+    pixman_region32_fini(&bar->repaint);
+    free(bar->hitmap);
+    pixman_glyph_cache_destroy(bar->glyph_cache);
+    wl_array_release(&bar->glyph);
     struct canvas *canvas, *canvas_tmp;
     wl_list_for_each_safe(canvas, canvas_tmp, &bar->canvas, link)
     {
         canvas_destroy(canvas);
     }
+    if (bar->wl_shm_pool != NULL) wl_shm_pool_destroy(bar->wl_shm_pool);
+    if (bar->pool_data != NULL) munmap(bar->pool_data, bar->pool_size);
+    if (bar->pool_fd >= 0) close(bar->pool_fd);
+    if (bar->wl_callback != NULL) wl_callback_destroy(bar->wl_callback);
     if (bar->zwlr_layer_surface != NULL) zwlr_layer_surface_v1_destroy(bar->zwlr_layer_surface);
     if (bar->wp_viewport != NULL) wp_viewport_destroy(bar->wp_viewport);
     if (bar->wp_fractional_scale != NULL) wp_fractional_scale_v1_destroy(bar->wp_fractional_scale);
     if (bar->wl_surface != NULL) wl_surface_destroy(bar->wl_surface);
-    wl_output_release(bar->wl_output);
+    if (bar->wl_output != NULL) wl_output_release(bar->wl_output);
     wl_list_remove(&bar->link);
     free(bar);
 }
 
-struct pointer {
-    char name[16];
-    struct wl_seat* wl_seat;
-    uint32_t wl_seat_name;
-    struct wl_pointer* wl_pointer;
-    struct wl_surface* wl_surface;
-    uint32_t x, y, time;
-    struct wl_list link;
-    bool managed;
-};
-
-static void pointer_destroy(struct pointer* pointer)
-{
-    if (pointer->wl_pointer != NULL) wl_pointer_release(pointer->wl_pointer);
-    wl_seat_release(pointer->wl_seat);
-    wl_list_remove(&pointer->link);
-    free(pointer);
-}
-
 struct item {
     const char* value;
+    uint32_t index;
     struct wl_list* last;
 };
 
@@ -148,8 +244,14 @@ enum {
     ITEM_SIZE,
 };
 
+struct style {
+    uint32_t bg, fg, font;
+};
+
 struct entry {
     struct item item[ITEM_SIZE];
+    uint32_t style;
+    uint32_t output;
     const char* text;
     struct wl_list link;
 };
@@ -160,21 +262,132 @@ static void entry_destroy(struct entry* entry)
     free(entry);
 }
 
+struct slot {
+    uint32_t part;
+    struct wl_array text;
+    uint64_t hash;
+    struct wl_list entry;
+};
+
+enum {
+    POLICY_DROP,
+    POLICY_COALESCE,
+};
+
+enum {
+    MODULE_NONE,
+    MODULE_CPU,
+    MODULE_MEM,
+    MODULE_NET,
+    MODULE_BACKLIGHT,
+    MODULE_CLOCK,
+    MODULE_SIZE,
+};
+
+struct source {
+    const char* name;
+    int fd;
+    struct wl_array buffer;
+    struct wl_array line;
+    uint64_t hash;
+    uint32_t slot, slot_count;
+    const char* command;
+    uint32_t interval, backoff;
+    int timer_fd;
+    pid_t pid;
+    uint64_t spawn_time;
+    int module;
+    const char* format;
+    int module_fd[2];
+    uint64_t module_last[2];
+};
+
+struct hit {
+    uint32_t x, y, width, height;
+    const char* action[ITEM_SIZE - ITEM_ACT1];
+};
+
+struct hitmap {
+    uint32_t width, height, surface_width, surface_height;
+    size_t count;
+    struct hit hit[];
+};
+
+struct pointer {
+    char name[16];
+    struct wl_seat* wl_seat;
+    uint32_t wl_seat_name;
+    struct wl_pointer* wl_pointer;
+    struct wl_surface* wl_surface;
+    uint32_t x, y;
+    wl_fixed_t axis_value[2];
+    int32_t axis120[2], axis_remainder[2];
+    bool axis_discrete[2];
+    uint64_t action_time[ITEM_SIZE - ITEM_ACT1];
+    uint32_t action_count[ITEM_SIZE - ITEM_ACT1];
+    char* action_pending[ITEM_SIZE - ITEM_ACT1];
+    struct wl_list link;
+    bool managed;
+};
+
+static void pointer_destroy(struct pointer* pointer)
+{
+    if (pointer->wl_pointer != NULL) wl_pointer_release(pointer->wl_pointer);
+    wl_seat_release(pointer->wl_seat);
+    for (int i = 0; i < ITEM_SIZE - ITEM_ACT1; i++) {
+        free(pointer->action_pending[i]);
+    }
+    wl_list_remove(&pointer->link);
+    free(pointer);
+}
+
+struct trace {
+    struct wp_presentation_feedback* wp_presentation_feedback;
+    uint64_t time[TRACE_SIZE];
+    struct wl_list link;
+};
+
+static void trace_destroy(struct trace* trace)
+{
+    wp_presentation_feedback_destroy(trace->wp_presentation_feedback);
+    wl_list_remove(&trace->link);
+    free(trace);
+}
+
 struct pipebar {
     const char* version;
     bool debug;
 
     char* colors;
     struct wl_array color;
+    struct wl_array fill;
     char* fonts;
     struct wl_array font;
     char* outputs;
     struct wl_array output;
+    struct wl_array output_name;
     char* seats;
+    char* pipes;
+    char* layout;
+    struct wl_array command;
+    bool binary;
+    struct wl_array frame;
+    int policy;
+    struct wl_array action_queue;
+    bool action_partial;
+    bool stdout_nonblock;
+    int stdout_flags;
+    uint32_t exec, action_running;
+    struct wl_array action_text;
+    uint32_t action_drop, action_coalesce;
+    sigset_t signal;
     struct wl_array seat;
     bool bottom;
     uint32_t gap;
     uint32_t throttle;
+    uint32_t fps;
+    uint32_t depth;
+    uint32_t jobs;
     char* replace;
 
     struct wl_display* wl_display;
@@ -190,18 +403,79 @@ struct pipebar {
     uint32_t wp_viewporter_name;
     struct zwlr_layer_shell_v1* zwlr_layer_shell;
     uint32_t zwlr_layer_shell_name;
+    struct wp_presentation* wp_presentation;
+    uint32_t wp_presentation_name;
+    clockid_t presentation_clock;
 
     uint32_t height;
+    uint32_t height_font;
     struct wl_list bar;
     struct wl_list pointer;
 
-    struct wl_array text[2];
+    struct wl_array source;
+    struct wl_array slot;
+    struct wl_list entry;
+    struct wl_array style;
+    uint32_t warned;
     struct wl_array codepoint;
-    struct wl_list part[PART_SIZE + 1];
+    struct wl_list font_cache;
+    struct wl_array preload;
+    pthread_t preload_thread;
+    bool preloading;
+    uint64_t startup_time[4];
+    pixman_image_t* scratch;
+    struct wl_array worker;
+    struct wl_array job;
+    size_t job_count, job_next, job_done;
+    bool job_quit;
+    pthread_mutex_t job_mutex;
+    pthread_cond_t job_cond, job_done_cond;
+    struct wl_list run;
+    struct wl_list run_stale;
+    uint32_t run_count, run_hit, run_miss;
+    uint64_t line_time;
+    struct wl_list trace;
+    uint32_t histogram[TRACE_SIZE][TRACE_BUCKETS];
+    uint64_t trace_max[TRACE_SIZE];
+    uint32_t canvas_count, action_count;
+    FILE* record;
+    FILE* replay;
+    double replay_speed;
+    struct wl_array replay_line;
+    uint32_t replay_source, replay_count;
+    uint64_t replay_time, replay_first, replay_start, replay_end;
+    bool replay_pending;
 } pipebar;
 
+static void run_destroy(struct run* run)
+{
+    struct bar* bar;
+    wl_list_for_each(bar, &pipebar.bar, link)
+    {
+        for (int i = 0; i < run->text_run->count; i++) {
+            pixman_glyph_cache_remove(bar->glyph_cache, run, (void*)run->text_run->glyphs[i]);
+        }
+    }
+    fcft_text_run_destroy(run->text_run);
+    wl_array_release(&run->codepoint);
+    wl_list_remove(&run->link);
+    free(run);
+}
+
 static void pipebar_destroy()
 {
+    if (pipebar.preloading) pthread_join(pipebar.preload_thread, NULL);
+    pthread_mutex_lock(&pipebar.job_mutex);
+    pipebar.job_quit = true;
+    pthread_cond_broadcast(&pipebar.job_cond);
+    pthread_mutex_unlock(&pipebar.job_mutex);
+    pthread_t* worker;
+    wl_array_for_each(worker, &pipebar.worker)
+    {
+        pthread_join(*worker, NULL);
+    }
+    wl_array_release(&pipebar.worker);
+    wl_array_release(&pipebar.job);
     struct bar *bar, *bar_tmp;
     wl_list_for_each_safe(bar, bar_tmp, &pipebar.bar, link)
     {
@@ -212,6 +486,15 @@ static void pipebar_destroy()
     {
         pointer_destroy(pointer);
     }
+    struct trace *trace, *trace_tmp;
+    wl_list_for_each_safe(trace, trace_tmp, &pipebar.trace, link)
+    {
+        trace_destroy(trace);
+    }
+    if (pipebar.wp_presentation != NULL) wp_presentation_destroy(pipebar.wp_presentation);
+    if (pipebar.record != NULL) fclose(pipebar.record);
+    if (pipebar.replay != NULL) fclose(pipebar.replay);
+    wl_array_release(&pipebar.replay_line);
     if (pipebar.zwlr_layer_shell != NULL) zwlr_layer_shell_v1_destroy(pipebar.zwlr_layer_shell);
     if (pipebar.wp_viewporter != NULL) wp_viewporter_destroy(pipebar.wp_viewporter);
     if (pipebar.wp_fractional_scale_manager != NULL) wp_fractional_scale_manager_v1_destroy(pipebar.wp_fractional_scale_manager);
@@ -222,17 +505,77 @@ static void pipebar_destroy()
     wl_array_release(&pipebar.color);
     wl_array_release(&pipebar.font);
     wl_array_release(&pipebar.output);
+    struct fcft_font** preload_font;
+    wl_array_for_each(preload_font, &pipebar.preload)
+    {
+        if (*preload_font != NULL) fcft_destroy(*preload_font);
+    }
+    wl_array_release(&pipebar.preload);
+    char** output_name;
+    wl_array_for_each(output_name, &pipebar.output_name)
+    {
+        free(*output_name);
+    }
+    wl_array_release(&pipebar.output_name);
     wl_array_release(&pipebar.seat);
-    for (int i = 0; i < 2; i++) {
-        wl_array_release(&pipebar.text[i]);
+    struct source* source;
+    wl_array_for_each(source, &pipebar.source)
+    {
+        if (source->pid > 0) kill(source->pid, SIGTERM);
+        if (source->timer_fd >= 0) close(source->timer_fd);
+        for (int i = 0; i < 2 && source->module != MODULE_NONE; i++) {
+            if (source->module_fd[i] >= 0) close(source->module_fd[i]);
+        }
+        if (source->fd > STDIN_FILENO) close(source->fd);
+        wl_array_release(&source->buffer);
+        wl_array_release(&source->line);
     }
-    for (int part_idx = PART_LEFT; part_idx <= PART_SIZE; part_idx++) {
-        struct entry *entry, *entry_tmp;
-        wl_list_for_each_safe(entry, entry_tmp, &pipebar.part[part_idx], link)
+    wl_array_release(&pipebar.source);
+    wl_array_release(&pipebar.command);
+    wl_array_release(&pipebar.frame);
+    wl_array_release(&pipebar.action_queue);
+    wl_array_release(&pipebar.action_text);
+    if (pipebar.stdout_nonblock) fcntl(STDOUT_FILENO, F_SETFL, pipebar.stdout_flags);
+    struct entry *entry, *entry_tmp;
+    struct slot* slot;
+    wl_array_for_each(slot, &pipebar.slot)
+    {
+        wl_list_for_each_safe(entry, entry_tmp, &slot->entry, link)
         {
             entry_destroy(entry);
         }
+        wl_array_release(&slot->text);
+    }
+    wl_array_release(&pipebar.slot);
+    wl_list_for_each_safe(entry, entry_tmp, &pipebar.entry, link)
+    {
+        entry_destroy(entry);
     }
+    struct run *run, *run_tmp;
+    wl_list_for_each_safe(run, run_tmp, &pipebar.run, link)
+    {
+        run_destroy(run);
+    }
+    wl_list_for_each_safe(run, run_tmp, &pipebar.run_stale, link)
+    {
+        run_destroy(run);
+    }
+    struct font *font, *font_tmp;
+    wl_list_for_each_safe(font, font_tmp, &pipebar.font_cache, link)
+    {
+        fcft_destroy(font->fcft_font);
+        wl_list_remove(&font->link);
+        free(font);
+    }
+    wl_array_release(&pipebar.style);
+    wl_array_release(&pipebar.codepoint);
+    pixman_image_t** fill;
+    wl_array_for_each(fill, &pipebar.fill)
+    {
+        pixman_image_unref(*fill);
+    }
+    wl_array_release(&pipebar.fill);
+    pixman_image_unref(pipebar.scratch);
     fcft_fini();
 }
 
@@ -259,74 +602,243 @@ static void msg(const int code, const char* restrict fmt, ...)
     exit(code);
 }
 
-static void randname(char* buf)
+static uint64_t now()
 {
     struct timespec ts;
-    clock_gettime(CLOCK_REALTIME, &ts);
-    long r = ts.tv_nsec;
-    for (int i = 0; i < 6; ++i) {
-        buf[i] = 'A' + (r & 15) + (r & 16) * 2;
-        r >>= 5;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void trace_record(const uint64_t* time)
+{
+    uint64_t last = time[TRACE_LINE];
+    for (int stage = TRACE_PARSE; stage <= TRACE_SIZE; stage++) {
+        int row = stage == TRACE_SIZE ? TRACE_LINE : stage;
+        if (stage < TRACE_SIZE && time[stage] == 0) continue;
+        uint64_t delta = stage == TRACE_SIZE ? last - time[TRACE_LINE] : time[stage] - last;
+        if (stage < TRACE_SIZE) last = time[stage];
+        uint64_t us = delta / 1000;
+        int bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+        pipebar.histogram[row][bucket < TRACE_BUCKETS ? bucket : TRACE_BUCKETS - 1]++;
+        if (delta > pipebar.trace_max[row]) pipebar.trace_max[row] = delta;
     }
 }
 
-static int create_shm_file(void)
+static void trace_dump()
 {
-    int retries = 100;
-    do {
-        char name[] = "/wl_shm-XXXXXX";
-        randname(name + sizeof(name) - 7);
-        --retries;
-        int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
-        if (fd >= 0) {
-            shm_unlink(name);
-            return fd;
-        }
-    } while (retries > 0 && errno == EEXIST);
-    return -1;
+    static const char* stage_name[TRACE_SIZE] = { "total", "parse", "shape", "composite", "commit", "present" };
+    fprintf(stderr, "%-10s %8s %10s %10s %10s %10s\n", "stage", "count", "p50(us)", "p90(us)", "p99(us)", "max(us)");
+    for (int row = TRACE_LINE; row < TRACE_SIZE; row++) {
+        uint64_t count = 0;
+        for (int bucket = 0; bucket < TRACE_BUCKETS; bucket++) {
+            count += pipebar.histogram[row][bucket];
+        }
+        uint64_t percentile[3] = {};
+        const uint32_t permille[3] = { 500, 900, 990 };
+        for (int i = 0; i < 3 && count != 0; i++) {
+            uint64_t seen = 0;
+            for (int bucket = 0; bucket < TRACE_BUCKETS; bucket++) {
+                seen += pipebar.histogram[row][bucket];
+                if (seen * 1000 >= count * permille[i]) {
+                    percentile[i] = bucket == 0 ? 1 : 1ull << bucket;
+                    break;
+                }
+            }
+        }
+        fprintf(stderr, "%-10s %8" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n", stage_name[row], count,
+            percentile[0], percentile[1], percentile[2], pipebar.trace_max[row] / 1000);
+    }
+
+    uint32_t pool_grow = 0, pool_starve = 0;
+    struct bar* bar;
+    wl_list_for_each(bar, &pipebar.bar, link)
+    {
+        pool_grow += bar->pool_grow;
+        pool_starve += bar->pool_starve;
+    }
+    fprintf(stderr, "canvases %u, pool grows %u, pool starves %u, runs shaped %u, run hits %u, actions %u, dropped %u, coalesced %u.\n",
+        pipebar.canvas_count, pool_grow, pool_starve, pipebar.run_miss, pipebar.run_hit,
+        pipebar.action_count, pipebar.action_drop, pipebar.action_coalesce);
+}
+
+static void record(const struct source* source, const char* data, size_t len)
+{
+    fprintf(pipebar.record, "%" PRIu64 " %td %zu\n", now(), source - (struct source*)pipebar.source.data, len);
+    fwrite(data, 1, len, pipebar.record);
+    fputc('\n', pipebar.record);
+}
+
+static uint64_t hash(const char* data, size_t size)
+{
+    uint64_t value = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        value ^= (unsigned char)data[i];
+        value *= 0x100000001b3ull;
+    }
+    return value;
+}
+
+static size_t ascii_widen_scalar(const unsigned char* src, size_t len, uint32_t* dst)
+{
+    size_t idx = 0;
+    while (idx < len && src[idx] < 0x80) {
+        dst[idx] = src[idx];
+        idx++;
+    }
+    return idx;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) static size_t ascii_widen_sse2(const unsigned char* src, size_t len, uint32_t* dst)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t idx = 0;
+    for (; idx + 16 <= len; idx += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)(src + idx));
+        if (_mm_movemask_epi8(chunk) != 0) break;
+        __m128i low = _mm_unpacklo_epi8(chunk, zero);
+        __m128i high = _mm_unpackhi_epi8(chunk, zero);
+        _mm_storeu_si128((__m128i*)(dst + idx), _mm_unpacklo_epi16(low, zero));
+        _mm_storeu_si128((__m128i*)(dst + idx + 4), _mm_unpackhi_epi16(low, zero));
+        _mm_storeu_si128((__m128i*)(dst + idx + 8), _mm_unpacklo_epi16(high, zero));
+        _mm_storeu_si128((__m128i*)(dst + idx + 12), _mm_unpackhi_epi16(high, zero));
+    }
+    return idx + ascii_widen_scalar(src + idx, len - idx, dst + idx);
+}
+
+__attribute__((target("avx2"))) static size_t ascii_widen_avx2(const unsigned char* src, size_t len, uint32_t* dst)
+{
+    size_t idx = 0;
+    for (; idx + 32 <= len; idx += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)(src + idx));
+        if (_mm256_movemask_epi8(chunk) != 0) break;
+        for (int i = 0; i < 32; i += 8) {
+            _mm256_storeu_si256((__m256i*)(dst + idx + i), _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + idx + i))));
+        }
+    }
+    return idx + ascii_widen_sse2(src + idx, len - idx, dst + idx);
+}
+#endif
+
+static size_t (*ascii_widen)(const unsigned char* src, size_t len, uint32_t* dst) = ascii_widen_scalar;
+
+static size_t utf8_decode(const char* text, size_t len, uint32_t* codepoint)
+{
+    const unsigned char* reader = (const unsigned char*)text;
+    size_t idx = 0, count = 0;
+    while (true) {
+        size_t ascii = ascii_widen(reader + idx, len - idx, codepoint + count);
+        idx += ascii;
+        count += ascii;
+        if (idx == len) break;
+
+        uint32_t value = 0;
+        int size = 0;
+        if (reader[idx] >= 0xc2 && reader[idx] <= 0xdf) {
+            value = reader[idx] & 0b11111;
+            size = 2;
+        } else if (reader[idx] >= 0xe0 && reader[idx] <= 0xef) {
+            value = reader[idx] & 0b1111;
+            size = 3;
+        } else if (reader[idx] >= 0xf0 && reader[idx] <= 0xf4) {
+            value = reader[idx] & 0b111;
+            size = 4;
+        }
+        int i = 1;
+        for (; i < size && idx + i < len && (reader[idx + i] & 0b11000000) == 0b10000000; i++) {
+            value = (value << 6) | (reader[idx + i] & 0b111111);
+        }
+        if (i < size || size == 0
+            || (size == 3 && (value < 0x800 || (value >= 0xd800 && value <= 0xdfff)))
+            || (size == 4 && (value < 0x10000 || value > 0x10ffff))) {
+            value = 0xfffd;
+        }
+        codepoint[count++] = value;
+        idx += i;
+    }
+    return count;
 }
 
-static int allocate_shm_file(size_t size)
+static void bar_pool_grow(struct bar* bar, size_t size)
 {
-    int fd = create_shm_file();
-    if (fd < 0)
-        return -1;
+    size_t pool_size = bar->pool_size == 0 ? size : bar->pool_size;
+    while (pool_size < size) {
+        pool_size *= 2;
+    }
+
+    if (bar->pool_fd < 0) {
+        bar->pool_fd = memfd_create("pipebar", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (bar->pool_fd < 0) {
+            msg(INNER_ERROR, "failed to create shared memory file.");
+        }
+    }
     int ret;
     do {
-        ret = ftruncate(fd, size);
+        ret = ftruncate(bar->pool_fd, pool_size);
     } while (ret < 0 && errno == EINTR);
     if (ret < 0) {
-        close(fd);
-        return -1;
+        msg(INNER_ERROR, "failed to allocate shared memory file.");
+    }
+
+    void* pool_data;
+    if (bar->pool_data == NULL) {
+        pool_data = mmap(NULL, pool_size, PROT_READ | PROT_WRITE, MAP_SHARED, bar->pool_fd, 0);
+    } else {
+        pool_data = mremap(bar->pool_data, bar->pool_size, pool_size, MREMAP_MAYMOVE);
+    }
+    if (pool_data == MAP_FAILED) {
+        msg(INNER_ERROR, "failed to map shared memory file.");
+    }
+    bar->pool_data = pool_data;
+    bar->pool_size = pool_size;
+    bar->pool_grow++;
+
+    if (bar->wl_shm_pool != NULL) {
+        wl_shm_pool_resize(bar->wl_shm_pool, bar->pool_size);
+    } else if (pipebar.wl_shm != NULL) {
+        fcntl(bar->pool_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL);
+        bar->wl_shm_pool = wl_shm_create_pool(pipebar.wl_shm, bar->pool_fd, bar->pool_size);
+    }
+
+    struct canvas* canvas;
+    wl_list_for_each(canvas, &bar->canvas, link)
+    {
+        pixman_image_unref(canvas->image);
+        canvas->image = pixman_image_create_bits(PIXMAN_a8r8g8b8, canvas->width, canvas->height, bar->pool_data + canvas->offset, canvas->width * 4);
     }
-    return fd;
 }
 
 static struct canvas* canvas_new(struct bar* bar)
 {
-    int fd = allocate_shm_file(bar->canvas_width * bar->canvas_height * 4);
-    if (fd == -1) {
-        msg(INNER_ERROR, "failed to allocate shared memory file.");
+    size_t size = bar->canvas_width * bar->canvas_height * 4;
+    size_t offset = 0;
+    for (bool overlap = true; overlap;) {
+        overlap = false;
+        struct canvas* each;
+        wl_list_for_each(each, &bar->canvas, link)
+        {
+            size_t each_end = each->offset + each->width * each->height * 4;
+            if (offset < each_end && each->offset < offset + size) {
+                offset = each_end;
+                overlap = true;
+            }
+        }
     }
-    void* mmapped = mmap(NULL, bar->canvas_width * bar->canvas_height * 4, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-    if (mmapped == MAP_FAILED) {
-        close(fd);
-        msg(INNER_ERROR, "failed to map shared memory file.");
+    if (offset + size > bar->pool_size) {
+        bar_pool_grow(bar, offset + size > pipebar.depth * size ? offset + size : pipebar.depth * size);
     }
-    pixman_image_t* image = pixman_image_create_bits(PIXMAN_a8r8g8b8, bar->canvas_width, bar->canvas_height, mmapped, bar->canvas_width * 4);
-    struct wl_shm_pool* pool = wl_shm_create_pool(pipebar.wl_shm, fd, bar->canvas_width * bar->canvas_height * 4);
-    struct wl_buffer* wl_buffer = wl_shm_pool_create_buffer(pool, 0, bar->canvas_width, bar->canvas_height, bar->canvas_width * 4, WL_SHM_FORMAT_ARGB8888);
-    wl_shm_pool_destroy(pool);
-    close(fd);
 
     struct canvas* canvas = calloc(1, sizeof(struct canvas));
     canvas->width = bar->canvas_width;
     canvas->height = bar->canvas_height;
-    canvas->mmapped = mmapped;
-    canvas->image = image;
-    canvas->wl_buffer = wl_buffer;
+    canvas->offset = offset;
+    canvas->image = pixman_image_create_bits(PIXMAN_a8r8g8b8, canvas->width, canvas->height, bar->pool_data + canvas->offset, canvas->width * 4);
+    if (bar->wl_shm_pool != NULL) {
+        canvas->wl_buffer = wl_shm_pool_create_buffer(bar->wl_shm_pool, canvas->offset, canvas->width, canvas->height, canvas->width * 4, WL_SHM_FORMAT_ARGB8888);
+    }
     canvas->bar = bar;
     wl_list_insert(&bar->canvas, &canvas->link);
+    pipebar.canvas_count++;
     return canvas;
 }
 
@@ -347,7 +859,18 @@ static struct bar* bar_new(struct wl_output* wl_output, uint32_t name)
     for (int part_idx = PART_LEFT; part_idx <= PART_SIZE; part_idx++) {
         wl_list_init(&bar->part[part_idx]);
     }
+    for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
+        wl_array_init(&bar->layout[part_idx]);
+    }
+    for (int i = 0; i < DAMAGE_SIZE; i++) {
+        pixman_region32_init(&bar->damage[i]);
+    }
+    pixman_region32_init(&bar->repaint);
+    bar->glyph_cache = pixman_glyph_cache_create();
+    wl_array_init(&bar->glyph);
     wl_list_init(&bar->canvas);
+    bar->pool_fd = -1;
+    bar->dirty = (1 << (PART_SIZE + 1)) - 1;
     wl_list_insert(&pipebar.bar, &bar->link);
     return bar;
 }
@@ -364,30 +887,188 @@ static struct pointer* pointer_new(struct wl_seat* wl_seat, uint32_t name)
 static struct entry* entry_new()
 {
     struct entry* entry = calloc(1, sizeof(struct entry));
-    wl_list_insert(&pipebar.part[PART_SIZE], &entry->link);
+    wl_list_insert(&pipebar.entry, &entry->link);
     return entry;
 }
 
+// pixman validates an image lazily on first use, which must happen here and not on a render thread.
+static void image_prepare(pixman_image_t* image)
+{
+    pixman_image_composite32(PIXMAN_OP_OVER, image, NULL, pipebar.scratch, 0, 0, 0, 0, 0, 0, 0, 0);
+}
+
+static struct run* run_get(struct fcft_font* font, const uint32_t* codepoint, size_t count)
+{
+    struct run *run, *run_tmp;
+    wl_list_for_each_safe(run, run_tmp, &pipebar.run_stale, link)
+    {
+        if (run->refs == 0) run_destroy(run);
+    }
+
+    uint64_t run_hash = hash((const char*)codepoint, count * 4);
+    wl_list_for_each(run, &pipebar.run, link)
+    {
+        if (run->font == font && run->hash == run_hash && run->codepoint.size == count * 4 && memcmp(run->codepoint.data, codepoint, count * 4) == 0) {
+            wl_list_remove(&run->link);
+            wl_list_insert(&pipebar.run, &run->link);
+            run->refs++;
+            pipebar.run_hit++;
+            return run;
+        }
+    }
+    pipebar.run_miss++;
+
+    if (pipebar.run_count >= RUN_CACHE_SIZE) {
+        wl_list_for_each_reverse_safe(run, run_tmp, &pipebar.run, link)
+        {
+            if (run->refs == 0) {
+                run_destroy(run);
+                pipebar.run_count--;
+                break;
+            }
+        }
+    }
+
+    run = calloc(1, sizeof(struct run));
+    run->font = font;
+    run->hash = run_hash;
+    wl_array_init(&run->codepoint);
+    memcpy(wl_array_add(&run->codepoint, count * 4), codepoint, count * 4);
+    run->text_run = fcft_rasterize_text_run_utf32(font, count, codepoint, FCFT_SUBPIXEL_DEFAULT);
+    for (int i = 0; i < run->text_run->count; i++) {
+        run->width += run->text_run->glyphs[i]->advance.x;
+        image_prepare(run->text_run->glyphs[i]->pix);
+    }
+    run->refs = 1;
+    wl_list_insert(&pipebar.run, &run->link);
+    pipebar.run_count++;
+    return run;
+}
+
+static void run_forget(struct fcft_font* font)
+{
+    struct run *run, *run_tmp;
+    wl_list_for_each_safe(run, run_tmp, &pipebar.run, link)
+    {
+        if (run->font != font) continue;
+        pipebar.run_count--;
+        if (run->refs == 0) {
+            run_destroy(run);
+        } else {
+            run->font = NULL;
+            wl_list_remove(&run->link);
+            wl_list_insert(&pipebar.run_stale, &run->link);
+        }
+    }
+}
+
+static void font_destroy(struct font* font)
+{
+    run_forget(font->fcft_font);
+    fcft_destroy(font->fcft_font);
+    wl_list_remove(&font->link);
+    free(font);
+}
+
+static struct font* font_get(const char* name, uint32_t dpi)
+{
+    struct font *font, *font_tmp;
+    wl_list_for_each(font, &pipebar.font_cache, link)
+    {
+        if (font->dpi == dpi && strcmp(font->name, name) == 0) {
+            wl_list_remove(&font->link);
+            wl_list_insert(&pipebar.font_cache, &font->link);
+            font->refs++;
+            return font;
+        }
+    }
+
+    char dpi_attr[16];
+    sprintf(dpi_attr, "dpi=%u", dpi);
+    font = calloc(1, sizeof(struct font));
+    font->name = name;
+    font->dpi = dpi;
+    font->fcft_font = fcft_from_name(1, (const char*[]) { name }, dpi_attr);
+    if (font->fcft_font == NULL) {
+        free(font);
+        msg(RUNTIME_ERROR, "failed to load font %s.", name);
+    }
+    font->refs = 1;
+    wl_list_insert(&pipebar.font_cache, &font->link);
+
+    uint32_t idle_count = 0;
+    wl_list_for_each_safe(font, font_tmp, &pipebar.font_cache, link)
+    {
+        if (font->refs == 0 && ++idle_count > pipebar.font.size / sizeof(char*) * FONT_CACHE_SCALES) {
+            font_destroy(font);
+        }
+    }
+    return wl_container_of(pipebar.font_cache.next, font, link);
+}
+
+static uint32_t output_intern(const char* name)
+{
+    char** output_name;
+    wl_array_for_each(output_name, &pipebar.output_name)
+    {
+        if (strcmp(*output_name, name) == 0) break;
+    }
+    if ((void*)output_name == pipebar.output_name.data + pipebar.output_name.size) {
+        output_name = wl_array_add(&pipebar.output_name, sizeof(char*));
+        *output_name = strdup(name);
+        if (pipebar.output_name.size == (OUTPUT_SIZE + 1) * sizeof(char*)) {
+            msg(WARNING, "too many wayland output names. output %s and later are ignored.", name);
+        }
+    }
+    uint32_t output_idx = output_name - (char**)pipebar.output_name.data;
+    return output_idx < OUTPUT_SIZE ? 1u << output_idx : 0;
+}
+
 static void pipebar_init()
 {
     fcft_init(FCFT_LOG_COLORIZE_AUTO, false, FCFT_LOG_CLASS_ERROR);
     wl_array_init(&pipebar.color);
+    wl_array_init(&pipebar.fill);
     wl_array_init(&pipebar.font);
     wl_array_init(&pipebar.output);
+    wl_array_init(&pipebar.output_name);
     wl_array_init(&pipebar.seat);
     wl_list_init(&pipebar.bar);
     wl_list_init(&pipebar.pointer);
-    for (int i = 0; i < 2; i++) {
-        wl_array_init(&pipebar.text[i]);
-        wl_array_add(&pipebar.text[i], 256);
-        pipebar.text[i].size = 0;
-    }
+    wl_array_init(&pipebar.source);
+    wl_array_init(&pipebar.command);
+    wl_array_init(&pipebar.frame);
+    wl_array_init(&pipebar.action_queue);
+    wl_array_init(&pipebar.action_text);
+    wl_array_add(&pipebar.action_queue, ACTION_QUEUE_SIZE);
+    pipebar.action_queue.size = 0;
+    wl_array_init(&pipebar.slot);
+    wl_list_init(&pipebar.entry);
+    wl_array_init(&pipebar.style);
     wl_array_init(&pipebar.codepoint);
     wl_array_add(&pipebar.codepoint, 256);
     pipebar.codepoint.size = 0;
-    for (int part_idx = PART_LEFT; part_idx <= PART_SIZE; part_idx++) {
-        wl_list_init(&pipebar.part[part_idx]);
+    wl_list_init(&pipebar.font_cache);
+    wl_array_init(&pipebar.preload);
+    pipebar.scratch = pixman_image_create_bits(PIXMAN_a8r8g8b8, 1, 1, NULL, 0);
+    wl_array_init(&pipebar.worker);
+    wl_array_init(&pipebar.job);
+    pthread_mutex_init(&pipebar.job_mutex, NULL);
+    pthread_cond_init(&pipebar.job_cond, NULL);
+    pthread_cond_init(&pipebar.job_done_cond, NULL);
+    wl_list_init(&pipebar.run);
+    wl_list_init(&pipebar.run_stale);
+    wl_list_init(&pipebar.trace);
+    wl_array_init(&pipebar.replay_line);
+    pipebar.presentation_clock = CLOCK_MONOTONIC;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        ascii_widen = ascii_widen_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        ascii_widen = ascii_widen_sse2;
     }
+#endif
 }
 
 static void wl_buffer_handle_release(void* data, struct wl_buffer* wl_buffer)
@@ -398,13 +1079,7 @@ static void wl_buffer_handle_release(void* data, struct wl_buffer* wl_buffer)
     if (canvas->height != bar->canvas_height || canvas->width != bar->canvas_width) {
         canvas_destroy(canvas);
     } else {
-        wl_list_remove(&canvas->link);
-        struct canvas* first_canvas = wl_container_of(bar->canvas.next, first_canvas, link);
-        if (&first_canvas->link != &bar->canvas && !first_canvas->busy) {
-            canvas_destroy(first_canvas);
-        }
         canvas->busy = false;
-        wl_list_insert(&bar->canvas, &canvas->link);
     }
 }
 
@@ -412,36 +1087,83 @@ static const struct wl_buffer_listener wl_buffer_listener = {
     .release = wl_buffer_handle_release,
 };
 
-static void wp_fractional_scale_handle_preferred_scale(void* data, struct wp_fractional_scale_v1* wp_fractional_scale_v1, uint32_t scale)
+static void wl_callback_handle_done(void* data, struct wl_callback* wl_callback, uint32_t time)
 {
     struct bar* bar = data;
-    bar->scale = scale;
-    bar->canvas_width = bar->width * bar->scale / 120;
-
-    struct fcft_font** font;
-    wl_array_for_each(font, &bar->font)
-    {
-        fcft_destroy(*font);
-    }
-    bar->font.size = 0;
-
-    char dpi[16];
-    sprintf(dpi, "dpi=%u", 96 * bar->scale / 120);
-    bar->canvas_height = 0;
-    char** font_name;
-    wl_array_for_each(font_name, &pipebar.font)
-    {
-        font = wl_array_add(&bar->font, sizeof(struct fcft_font*));
-        *font = fcft_from_name(1, (const char*[]) { *font_name }, dpi);
-        if ((*font)->height > bar->canvas_height) {
-            bar->canvas_height = (*font)->height;
-        }
-    }
-    bar->redraw = true;
+    wl_callback_destroy(bar->wl_callback);
+    bar->wl_callback = NULL;
 }
 
-static const struct wp_fractional_scale_v1_listener wp_fractional_scale_listener = {
-    .preferred_scale = wp_fractional_scale_handle_preferred_scale,
+static const struct wl_callback_listener wl_callback_listener = {
+    .done = wl_callback_handle_done,
+};
+
+static void wp_presentation_handle_clock_id(void* data, struct wp_presentation* wp_presentation, uint32_t clk_id)
+{
+    pipebar.presentation_clock = clk_id;
+}
+
+static const struct wp_presentation_listener wp_presentation_listener = {
+    .clock_id = wp_presentation_handle_clock_id,
+};
+
+static void wp_presentation_feedback_handle_sync_output(void* data, struct wp_presentation_feedback* wp_presentation_feedback, struct wl_output* wl_output) { }
+
+static void wp_presentation_feedback_handle_presented(void* data, struct wp_presentation_feedback* wp_presentation_feedback, uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags)
+{
+    struct trace* trace = data;
+    if (pipebar.presentation_clock == CLOCK_MONOTONIC) {
+        trace->time[TRACE_PRESENT] = (((uint64_t)tv_sec_hi << 32) + tv_sec_lo) * 1000000000ull + tv_nsec;
+    } else {
+        trace->time[TRACE_PRESENT] = now();
+    }
+    trace_record(trace->time);
+    trace_destroy(trace);
+}
+
+static void wp_presentation_feedback_handle_discarded(void* data, struct wp_presentation_feedback* wp_presentation_feedback)
+{
+    struct trace* trace = data;
+    trace_record(trace->time);
+    trace_destroy(trace);
+}
+
+static const struct wp_presentation_feedback_listener wp_presentation_feedback_listener = {
+    .sync_output = wp_presentation_feedback_handle_sync_output,
+    .presented = wp_presentation_feedback_handle_presented,
+    .discarded = wp_presentation_feedback_handle_discarded,
+};
+
+static void wp_fractional_scale_handle_preferred_scale(void* data, struct wp_fractional_scale_v1* wp_fractional_scale_v1, uint32_t scale)
+{
+    struct bar* bar = data;
+    if (bar->font.size != 0 && bar->scale == scale) return;
+    bar->scale = scale;
+    bar->canvas_width = bar->width * bar->scale / 120;
+
+    if (bar->font.size == 0) {
+        memset(wl_array_add(&bar->font, pipebar.font.size / sizeof(char*) * sizeof(struct font*)), 0, bar->font.size);
+    }
+
+    char** font_name = pipebar.font.data;
+    struct font* base_font = font_get(font_name[0], 96 * bar->scale / 120);
+    struct font* height_font = pipebar.height_font == 0 ? base_font : font_get(font_name[pipebar.height_font], 96 * bar->scale / 120);
+    struct font** font;
+    wl_array_for_each(font, &bar->font)
+    {
+        font_put(*font);
+        *font = NULL;
+    }
+    font = bar->font.data;
+    font[0] = base_font;
+    font[pipebar.height_font] = height_font;
+    bar->canvas_height = font[pipebar.height_font]->fcft_font->height;
+    bar->dirty = (1 << (PART_SIZE + 1)) - 1;
+    bar->redraw = true;
+}
+
+static const struct wp_fractional_scale_v1_listener wp_fractional_scale_listener = {
+    .preferred_scale = wp_fractional_scale_handle_preferred_scale,
 };
 
 static void zwlr_layer_surface_handle_configure(void* data, struct zwlr_layer_surface_v1* zwlr_layer_surface, uint32_t serial, uint32_t width, uint32_t height)
@@ -451,6 +1173,7 @@ static void zwlr_layer_surface_handle_configure(void* data, struct zwlr_layer_su
     bar->width = width;
     wp_viewport_set_destination(bar->wp_viewport, bar->width, pipebar.height);
     bar->canvas_width = bar->width * bar->scale / 120;
+    bar->dirty |= 1 << PART_SIZE;
     bar->redraw = true;
 }
 
@@ -469,6 +1192,8 @@ static void wl_output_handle_name(void* data, struct wl_output* wl_output, const
 {
     struct bar* bar = data;
     strcpy(bar->name, name);
+    bar->output = output_intern(name);
+    if (bar->output == 0) bar->output = 1u << OUTPUT_SIZE;
 }
 
 static void wl_output_handle_done(void* data, struct wl_output* wl_output)
@@ -546,83 +1271,273 @@ static void wl_pointer_handle_motion(void* data, struct wl_pointer* wl_pointer,
     pointer->y = wl_fixed_to_double(surface_y);
 }
 
-static void action(struct pointer* pointer, int item_idx)
+static pid_t spawn(const char* command, int stdout_fd)
+{
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_addopen(&file_actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    if (stdout_fd >= 0) {
+        posix_spawn_file_actions_adddup2(&file_actions, stdout_fd, STDOUT_FILENO);
+    } else {
+        posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    }
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+    extern char** environ;
+    pid_t pid;
+    char* argv[] = { "sh", "-c", (char*)command, NULL };
+    int error = posix_spawn(&pid, "/bin/sh", &file_actions, &attr, argv, environ);
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&file_actions);
+    return error == 0 ? pid : -1;
+}
+
+static void action_flush()
+{
+    struct wl_array* queue = &pipebar.action_queue;
+    if (queue->size == 0) return;
+    if (pipebar.exec != 0) {
+        char* line = queue->data;
+        char* end = line + queue->size;
+        while (line < end && pipebar.action_running < pipebar.exec) {
+            char* newline = memchr(line, '\n', end - line);
+            newline[0] = '\0';
+            if (spawn(line, -1) > 0) {
+                pipebar.action_running++;
+            } else {
+                msg(WARNING, "failed to spawn action %s.", line);
+            }
+            line = newline + 1;
+        }
+        queue->size = end - line;
+        memmove(queue->data, line, queue->size);
+        return;
+    }
+    ssize_t len = write(STDOUT_FILENO, queue->data, queue->size);
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EINTR) return;
+        msg(INNER_ERROR, "failed to write to STDOUT.");
+    }
+    pipebar.action_partial = ((char*)queue->data)[len - 1] != '\n';
+    queue->size -= len;
+    memmove(queue->data, (char*)queue->data + len, queue->size);
+}
+
+// the first queued line may be partially written already, so it is never coalesced or dropped.
+static void action_push(const char* action)
+{
+    struct wl_array* queue = &pipebar.action_queue;
+    size_t action_len = strlen(action) + 1;
+    char* end = (char*)queue->data + queue->size;
+    char* first = queue->data;
+    if (pipebar.action_partial) {
+        first = (char*)memchr(first, '\n', end - first) + 1;
+    }
+
+    if (pipebar.policy == POLICY_COALESCE) {
+        for (char* line = first; line < end; line = (char*)memchr(line, '\n', end - line) + 1) {
+            if (end - line >= action_len && memcmp(line, action, action_len - 1) == 0 && line[action_len - 1] == '\n') {
+                pipebar.action_coalesce++;
+                return;
+            }
+        }
+    }
+
+    while (queue->size + action_len > ACTION_QUEUE_SIZE) {
+        pipebar.action_drop++;
+        if (pipebar.debug) {
+            msg(WARNING, "action queue is full, %u actions dropped.", pipebar.action_drop);
+        }
+        if (pipebar.policy == POLICY_COALESCE || first == end) return;
+        char* next = (char*)memchr(first, '\n', end - first) + 1;
+        memmove(first, next, end - next);
+        queue->size -= next - first;
+        end = (char*)queue->data + queue->size;
+    }
+
+    char* line = wl_array_add(queue, action_len);
+    memcpy(line, action, action_len - 1);
+    line[action_len - 1] = '\n';
+    pipebar.action_count++;
+    action_flush();
+}
+
+static const struct hit* hitmap_lookup(const struct hitmap* hitmap, uint32_t x, uint32_t y)
+{
+    size_t low = 0, high = hitmap->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (hitmap->hit[mid].x <= x) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low == 0) return NULL;
+    const struct hit* hit = &hitmap->hit[low - 1];
+    if (x >= hit->x + hit->width || y < hit->y || y >= hit->y + hit->height) return NULL;
+    return hit;
+}
+
+static const char* action_lookup(struct pointer* pointer, int item_idx)
 {
     struct bar* bar;
     wl_list_for_each(bar, &pipebar.bar, link)
     {
         if (bar->wl_surface == pointer->wl_surface) {
-            if (!bar->redraw) {
-                uint32_t x = pointer->x * bar->canvas_width / bar->width;
-                uint32_t y = pointer->y * bar->canvas_height / pipebar.height;
-
-                struct block* block;
-                for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
-                    wl_list_for_each_reverse(block, &bar->part[part_idx], link)
-                    {
-                        if (x < block->x) {
-                            break;
-                        } else if (x < block->x + block->width) {
-                            const char* action = block->entry->item[item_idx].value;
-                            if (action != NULL && y >= block->y && y < block->y + block->height) {
-                                fprintf(stdout, "%s\n", action);
-                            }
-                            return;
-                        }
-                    }
-                }
+            const struct hitmap* hitmap = bar->hitmap;
+            if (hitmap != NULL && hitmap->surface_width != 0 && hitmap->surface_height != 0) {
+                uint32_t x = pointer->x * hitmap->width / hitmap->surface_width;
+                uint32_t y = pointer->y * hitmap->height / hitmap->surface_height;
+                const struct hit* hit = hitmap_lookup(hitmap, x, y);
+                if (hit != NULL) return hit->action[item_idx - ITEM_ACT1];
             }
             break;
         }
     }
+    return NULL;
 }
 
-static void wl_pointer_handle_button(void* data, struct wl_pointer* wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state)
+static void action_emit(const char* action, uint32_t count)
 {
-    if (state != WL_POINTER_BUTTON_STATE_PRESSED) return;
+    const char* found = strstr(action, pipebar.replace);
+    if (found == NULL) {
+        action_push(action);
+        return;
+    }
 
-    struct pointer* pointer = data;
+    struct wl_array* text = &pipebar.action_text;
+    char count_text[16];
+    size_t replace_len = strlen(pipebar.replace);
+    size_t count_len = snprintf(count_text, sizeof(count_text), "%u", count);
+    text->size = 0;
+    for (const char* reader = action;; found = strstr(reader, pipebar.replace)) {
+        size_t chunk_len = found == NULL ? strlen(reader) + 1 : found - reader;
+        memcpy(wl_array_add(text, chunk_len), reader, chunk_len);
+        if (found == NULL) break;
+        memcpy(wl_array_add(text, count_len), count_text, count_len);
+        reader = found + replace_len;
+    }
+    action_push(text->data);
+}
 
-    if (time - pointer->time < pipebar.throttle) {
-        return;
+static void action(struct pointer* pointer, int item_idx, uint32_t count)
+{
+    const char* action = action_lookup(pointer, item_idx);
+    if (action == NULL) return;
+
+    int action_idx = item_idx - ITEM_ACT1;
+    uint64_t time = now();
+    char** pending = &pointer->action_pending[action_idx];
+    if (*pending != NULL && strcmp(*pending, action) != 0) {
+        action_emit(*pending, pointer->action_count[action_idx]);
+        free(*pending);
+        *pending = NULL;
+    }
+    if (*pending == NULL && time - pointer->action_time[action_idx] >= pipebar.throttle * 1000000ull) {
+        action_emit(action, count);
+        pointer->action_time[action_idx] = time;
     } else {
-        pointer->time = time;
+        if (*pending == NULL) {
+            *pending = strdup(action);
+            pointer->action_count[action_idx] = 0;
+        }
+        pointer->action_count[action_idx] += count;
+    }
+}
+
+static int action_throttle(uint64_t time)
+{
+    int timeout = -1;
+    struct pointer* pointer;
+    wl_list_for_each(pointer, &pipebar.pointer, link)
+    {
+        for (int action_idx = 0; action_idx < ITEM_SIZE - ITEM_ACT1; action_idx++) {
+            char** pending = &pointer->action_pending[action_idx];
+            if (*pending == NULL) continue;
+            uint64_t deadline = pointer->action_time[action_idx] + pipebar.throttle * 1000000ull;
+            if (time >= deadline) {
+                action_emit(*pending, pointer->action_count[action_idx]);
+                free(*pending);
+                *pending = NULL;
+                pointer->action_time[action_idx] = time;
+            } else {
+                int wait = (deadline - time + 999999) / 1000000;
+                if (timeout < 0 || wait < timeout) timeout = wait;
+            }
+        }
     }
+    return timeout;
+}
+
+static void wl_pointer_handle_button(void* data, struct wl_pointer* wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state)
+{
+    if (state != WL_POINTER_BUTTON_STATE_PRESSED) return;
+
+    struct pointer* pointer = data;
 
     if (button == BTN_LEFT) {
-        action(pointer, ITEM_ACT1);
+        action(pointer, ITEM_ACT1, 1);
     } else if (button == BTN_MIDDLE) {
-        action(pointer, ITEM_ACT2);
+        action(pointer, ITEM_ACT2, 1);
     } else if (button == BTN_RIGHT) {
-        action(pointer, ITEM_ACT3);
+        action(pointer, ITEM_ACT3, 1);
     }
 }
 
 static void wl_pointer_handle_axis(void* data, struct wl_pointer* wl_pointer, uint32_t time, uint32_t axis, wl_fixed_t value)
 {
     struct pointer* pointer = data;
+    if (axis < 2) pointer->axis_value[axis] += value;
+}
 
-    if (time - pointer->time < pipebar.throttle) {
-        return;
-    } else {
-        pointer->time = time;
-    }
+static void wl_pointer_handle_axis_discrete(void* data, struct wl_pointer* wl_pointer, uint32_t axis, int32_t discrete)
+{
+    struct pointer* pointer = data;
+    if (axis >= 2) return;
+    pointer->axis120[axis] += discrete * 120;
+    pointer->axis_discrete[axis] = true;
+}
+
+static void wl_pointer_handle_axis_value120(void* data, struct wl_pointer* wl_pointer, uint32_t axis, int32_t value120)
+{
+    struct pointer* pointer = data;
+    if (axis >= 2) return;
+    pointer->axis120[axis] += value120;
+    pointer->axis_discrete[axis] = true;
+}
+
+static void wl_pointer_handle_axis_stop(void* data, struct wl_pointer* wl_pointer, uint32_t time, uint32_t axis)
+{
+    struct pointer* pointer = data;
+    if (axis < 2) pointer->axis_remainder[axis] = 0;
+}
 
-    if (axis == 0 && value > 0) {
-        action(pointer, ITEM_ACT4);
-    } else if (axis == 0 && value < 0) {
-        action(pointer, ITEM_ACT5);
-    } else if (axis == 1 && value > 0) {
-        action(pointer, ITEM_ACT6);
-    } else if (axis == 1 && value < 0) {
-        action(pointer, ITEM_ACT7);
+static void wl_pointer_handle_frame(void* data, struct wl_pointer* wl_pointer)
+{
+    static const int item[2][2] = { { ITEM_ACT4, ITEM_ACT5 }, { ITEM_ACT6, ITEM_ACT7 } };
+    struct pointer* pointer = data;
+    for (int axis = 0; axis < 2; axis++) {
+        int32_t value120 = pointer->axis_discrete[axis] ? pointer->axis120[axis] : pointer->axis_value[axis] / 32;
+        int32_t steps = (pointer->axis_remainder[axis] + value120) / 120;
+        pointer->axis_remainder[axis] += value120 - steps * 120;
+        if (steps > 0) {
+            action(pointer, item[axis][0], steps);
+        } else if (steps < 0) {
+            action(pointer, item[axis][1], -steps);
+        }
+        pointer->axis_value[axis] = 0;
+        pointer->axis120[axis] = 0;
+        pointer->axis_discrete[axis] = false;
     }
 }
 
-static void wl_pointer_handle_frame(void* data, struct wl_pointer* wl_pointer) { }
 static void wl_pointer_handle_axis_source(void* data, struct wl_pointer* wl_pointer, uint32_t axis_source) { }
-static void wl_pointer_handle_axis_stop(void* data, struct wl_pointer* wl_pointer, uint32_t time, uint32_t axis) { }
-static void wl_pointer_handle_axis_discrete(void* data, struct wl_pointer* wl_pointer, uint32_t axis, int32_t discrete) { }
 static const struct wl_pointer_listener wl_pointer_listener = {
     .enter = wl_pointer_handle_enter,
     .leave = wl_pointer_handle_leave,
@@ -633,6 +1548,7 @@ static const struct wl_pointer_listener wl_pointer_listener = {
     .axis_source = wl_pointer_handle_axis_source,
     .axis_stop = wl_pointer_handle_axis_stop,
     .axis_discrete = wl_pointer_handle_axis_discrete,
+    .axis_value120 = wl_pointer_handle_axis_value120,
 };
 
 static void wl_seat_handle_name(void* data, struct wl_seat* wl_seat, const char* name)
@@ -685,7 +1601,10 @@ static const struct wl_seat_listener wl_seat_listener = {
 static void wl_registry_handle_global(void* data, struct wl_registry* wl_registry, uint32_t name, const char* interface, uint32_t version)
 {
     if (!strcmp(interface, wl_compositor_interface.name)) {
-        pipebar.wl_compositor = wl_registry_bind(wl_registry, name, &wl_compositor_interface, 3);
+        if (version < 4) {
+            msg(INNER_ERROR, "wayland compositor version %u is lower than 4.", version);
+        }
+        pipebar.wl_compositor = wl_registry_bind(wl_registry, name, &wl_compositor_interface, 4);
         pipebar.wl_compositor_name = name;
     } else if (!strcmp(interface, wl_shm_interface.name)) {
         pipebar.wl_shm = wl_registry_bind(wl_registry, name, &wl_shm_interface, 2);
@@ -699,11 +1618,19 @@ static void wl_registry_handle_global(void* data, struct wl_registry* wl_registr
     } else if (!strcmp(interface, zwlr_layer_shell_v1_interface.name)) {
         pipebar.zwlr_layer_shell = wl_registry_bind(wl_registry, name, &zwlr_layer_shell_v1_interface, 3);
         pipebar.zwlr_layer_shell_name = name;
+    } else if (!strcmp(interface, wp_presentation_interface.name)) {
+        if (!pipebar.debug) return;
+        pipebar.wp_presentation = wl_registry_bind(wl_registry, name, &wp_presentation_interface, 1);
+        pipebar.wp_presentation_name = name;
+        wp_presentation_add_listener(pipebar.wp_presentation, &wp_presentation_listener, NULL);
     } else if (!strcmp(interface, wl_output_interface.name)) {
         struct bar* bar = bar_new(wl_registry_bind(wl_registry, name, &wl_output_interface, 4), name);
         wl_output_add_listener(bar->wl_output, &wl_output_listener, bar);
     } else if (!strcmp(interface, wl_seat_interface.name)) {
-        struct pointer* pointer = pointer_new(wl_registry_bind(wl_registry, name, &wl_seat_interface, 5), name);
+        if (version < 5) {
+            msg(INNER_ERROR, "wayland seat version %u is lower than 5.", version);
+        }
+        struct pointer* pointer = pointer_new(wl_registry_bind(wl_registry, name, &wl_seat_interface, version < 8 ? version : 8), name);
         wl_seat_add_listener(pointer->wl_seat, &wl_seat_listener, pointer);
     }
 }
@@ -720,6 +1647,9 @@ static void wl_registry_handle_global_remove(void* data, struct wl_registry* wl_
         msg(INNER_ERROR, "Wayland viewporter removed.");
     } else if (name == pipebar.zwlr_layer_shell_name) {
         msg(INNER_ERROR, "Wayland layer shell removed.");
+    } else if (name == pipebar.wp_presentation_name && pipebar.wp_presentation != NULL) {
+        wp_presentation_destroy(pipebar.wp_presentation);
+        pipebar.wp_presentation = NULL;
     } else {
         struct bar *bar, *bar_tmp;
         wl_list_for_each_safe(bar, bar_tmp, &pipebar.bar, link)
@@ -745,11 +1675,73 @@ static const struct wl_registry_listener wl_registry_listener = {
     .global_remove = wl_registry_handle_global_remove,
 };
 
+static void module_open(struct source* source)
+{
+    static const char* const name[] = { NULL, "cpu", "mem", "net", "backlight", "clock" };
+    static const char* const format[] = { NULL, "{}%", "{}%", "{}", "{}%", "%H:%M" };
+    const char* module = source->command + 1;
+    size_t name_len = strcspn(module, "=");
+    for (int module_idx = MODULE_CPU; module_idx < MODULE_SIZE; module_idx++) {
+        if (strlen(name[module_idx]) == name_len && strncmp(name[module_idx], module, name_len) == 0) {
+            source->module = module_idx;
+        }
+    }
+    if (source->module == MODULE_NONE) {
+        msg(RUNTIME_ERROR, "unknown module: %s.", module);
+    }
+    if (source->interval == 0 && source->module != MODULE_BACKLIGHT) {
+        msg(RUNTIME_ERROR, "option -e got a zero interval for module %s.", name[source->module]);
+    }
+    source->format = module[name_len] == '=' ? module + name_len + 1 : format[source->module];
+    source->module_fd[0] = -1;
+    source->module_fd[1] = -1;
+
+    char path[PATH_MAX];
+    switch (source->module) {
+    case MODULE_CPU:
+        source->module_fd[0] = open("/proc/stat", O_RDONLY | O_CLOEXEC);
+        break;
+    case MODULE_MEM:
+        source->module_fd[0] = open("/proc/meminfo", O_RDONLY | O_CLOEXEC);
+        break;
+    case MODULE_NET:
+        source->module_fd[0] = open("/proc/net/dev", O_RDONLY | O_CLOEXEC);
+        break;
+    case MODULE_BACKLIGHT: {
+        DIR* dir = opendir("/sys/class/backlight");
+        struct dirent* dirent = NULL;
+        while (dir != NULL && (dirent = readdir(dir)) != NULL && dirent->d_name[0] == '.') { }
+        if (dirent != NULL) {
+            snprintf(path, sizeof(path), "/sys/class/backlight/%s/max_brightness", dirent->d_name);
+            source->module_fd[1] = open(path, O_RDONLY | O_CLOEXEC);
+            snprintf(path, sizeof(path), "/sys/class/backlight/%s/brightness", dirent->d_name);
+            source->module_fd[0] = open(path, O_RDONLY | O_CLOEXEC);
+        }
+        if (dir != NULL) closedir(dir);
+        if (source->module_fd[0] >= 0 && source->module_fd[1] >= 0) {
+            source->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (source->fd >= 0 && inotify_add_watch(source->fd, path, IN_MODIFY) < 0) {
+                close(source->fd);
+                source->fd = -1;
+            }
+        } else {
+            msg(RUNTIME_ERROR, "failed to find a backlight device.");
+        }
+        break;
+    }
+    case MODULE_CLOCK:
+        return;
+    }
+    if (source->module_fd[0] < 0) {
+        msg(RUNTIME_ERROR, "failed to open the files of module %s.", module);
+    }
+}
+
 static void set_pipe()
 {
     struct stat stdin_stat;
     fstat(STDIN_FILENO, &stdin_stat);
-    if (!S_ISFIFO(stdin_stat.st_mode)) {
+    if (!S_ISFIFO(stdin_stat.st_mode) && pipebar.pipes == NULL && pipebar.command.size == 0 && pipebar.replay == NULL) {
         msg(NO_ERROR,
             "pipebar is a featherweight text-rendering wayland statusbar.\n"
             "It renders utf-8 sequence from STDIN line by line.\n"
@@ -763,9 +1755,22 @@ static void set_pipe()
             "        -f font,...     set fonts list (monospace)\n"
             "        -o output,...   set wayland outputs list\n"
             "        -s seat,...     set wayland seats list\n"
+            "        -p pipe,...     set extra input sources list\n"
+            "        -e interval:cmd add a block command as input source (repeatable)\n"
+            "        -a limit        run actions by /bin/sh, at most limit at once (0 prints them)\n"
             "        -b              place the bar at the bottom\n"
+            "        -d              print debug information and latency traces to STDERR, dump them on SIGUSR1\n"
             "        -g gap          set margin gap (0)\n"
-            "        -i interval     set pointer event throttle interval in ms (100)\n"
+            "        -i interval     set per action throttle interval in ms (100)\n"
+            "        -j jobs         set render thread count (1)\n"
+            "        -l layout       set input sources of each part, required by -p and -e\n"
+            "        -m fps          set max redraw rate per second, 0 means unlimited (0)\n"
+            "        -n depth        set buffer ring depth per bar (3)\n"
+            "        -q policy       set action queue overflow policy, drop or coalesce (drop)\n"
+            "        -x              read STDIN and pipes as binary frames\n"
+            "        --record file   record input lines with timestamps to file\n"
+            "        --replay file:n replay recorded input lines at n times speed (1), implies -d\n"
+            "                        0 means as fast as possible, and a summary is printed at the end\n"
             "\n"
             "color can be: (support 0/1/2/3/4/6/8 hex numbers)\n"
             "        <empty>         -> 00000000\n"
@@ -784,6 +1789,27 @@ static void set_pipe()
             "output/seat can be: (see 'wayland-info')\n"
             "        name            output/seat name\n"
             "\n"
+            "pipe can be: (numbered from 1, STDIN is 0)\n"
+            "        path            FIFO or file path\n"
+            "        fd              inherited file descriptor number\n"
+            "\n"
+            "interval:cmd can be: (numbered after pipes, run by /bin/sh)\n"
+            "        0:cmd           keep cmd running, restart it with backoff when it exits\n"
+            "        n:cmd           run cmd every n seconds, aligned to the wall clock\n"
+            "        n:@module       run a built-in module every n seconds instead of a command\n"
+            "                        n can be 0 only for backlight, which is updated on change\n"
+            "\n"
+            "module can be: ({} in format is replaced by the value)\n"
+            "        cpu=format      cpu usage percent ({}%%)\n"
+            "        mem=format      memory usage percent ({}%%)\n"
+            "        net=format      network throughput ({})\n"
+            "        backlight=format backlight percent, also updated on change ({}%%)\n"
+            "        clock=format    strftime format (%%H:%%M)\n"
+            "\n"
+            "layout can be: (without it, STDIN lines are split into parts by D)\n"
+            "        l,l:c,c:r,r     input source numbers of left:center:right part\n"
+            "                        each source owns a segment, D is not allowed\n"
+            "\n"
             "Sequence between a pair of '\\x1f' will be escaped instead of being rendered directly.\n"
             "Valid escape sequences are:\n"
             "        Bindex          set background color index (initially 0)\n"
@@ -816,300 +1842,707 @@ static void set_pipe()
             "        1               the second item in colors/fonts list\n"
             "        ...             ...\n"
             "\n"
-            "action can be:\n"
+            "action can be: (events within the throttle interval are merged into one action)\n"
             "        xxx             anything except for '\\x1f'\n"
+            "        xxx{}xxx        {} is replaced by the repeat count of merged events\n"
+            "\n"
+            "policy can be: (actions are queued when the consumer is slow)\n"
+            "        drop            drop the oldest queued actions when the queue is full\n"
+            "        coalesce        skip actions already queued, drop new ones when full\n"
+            "\n"
+            "binary frame is: (little endian, text may contain anything except for NUL)\n"
+            "        u32 length      byte length of the rest of the frame, at most 1MiB\n"
+            "        u16 segment     segment of the source, parts of STDIN without layout\n"
+            "        field...        u8 type, u8 padding, u16 length, payload\n"
+            "field type can be:\n"
+            "        0               text to render\n"
+            "        B/F/T           u16 index, or empty to restore\n"
+            "        O/1-7           output or action, or empty to restore\n"
+            "        R               swap background color and foreground color\n"
             "\n",
             pipebar.version);
     }
 
-    setvbuf(stdout, NULL, _IOLBF, 0);
-}
-
-static void parse()
-{
-    for (int part_idx = 0; part_idx < PART_SIZE; part_idx++) {
-        struct entry *entry, *entry_tmp;
-        wl_list_for_each_reverse_safe(entry, entry_tmp, &pipebar.part[part_idx], link)
-        {
-            wl_list_remove(&entry->link);
-            wl_list_insert(&pipebar.part[PART_SIZE], &entry->link);
+    struct source* source = wl_array_add(&pipebar.source, sizeof(struct source));
+    *source = (struct source) { .name = "STDIN", .fd = S_ISFIFO(stdin_stat.st_mode) ? STDIN_FILENO : -1, .timer_fd = -1 };
+    if (pipebar.pipes != NULL) {
+        for (char *head = pipebar.pipes, *reader = pipebar.pipes;; reader++) {
+            if (reader[0] != ',' && reader[0] != '\0') continue;
+            bool end = reader[0] == '\0';
+            reader[0] = '\0';
+            source = wl_array_add(&pipebar.source, sizeof(struct source));
+            *source = (struct source) { .name = head, .fd = -1, .timer_fd = -1 };
+            char* endptr;
+            long fd = strtol(head, &endptr, 10);
+            if (pipebar.replay == NULL && head[0] != '\0' && *endptr == '\0') {
+                source->fd = fd;
+            } else if (pipebar.replay == NULL) {
+                // a FIFO also opened for writing never reports EOF while its writers come and go.
+                struct stat pipe_stat;
+                if (stat(head, &pipe_stat) == 0) {
+                    source->fd = open(head, (S_ISFIFO(pipe_stat.st_mode) ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+                }
+                if (source->fd < 0) {
+                    msg(RUNTIME_ERROR, "failed to open input source %s.", head);
+                }
+            }
+            if (end) {
+                break;
+            } else {
+                head = reader + 1;
+            }
         }
     }
 
-    const char* reader = pipebar.text[0].data;
-    for (int part_idx = PART_LEFT; (void*)reader < pipebar.text[0].data + pipebar.text[0].size; part_idx++) {
-        if (part_idx == PART_SIZE) {
-            msg(WARNING, "too many delimiters.");
-            break;
+    char** command;
+    wl_array_for_each(command, &pipebar.command)
+    {
+        char* endptr;
+        unsigned long interval = strtoul(*command, &endptr, 10);
+        if (endptr == *command || *endptr != ':' || endptr[1] == '\0') {
+            msg(RUNTIME_ERROR, "option -e got a invalid argument: %s.", *command);
         }
+        source = wl_array_add(&pipebar.source, sizeof(struct source));
+        *source = (struct source) { .name = endptr + 1, .fd = -1, .command = endptr + 1, .interval = interval, .backoff = BLOCK_BACKOFF_MIN };
+        source->timer_fd = timerfd_create(interval != 0 ? CLOCK_REALTIME : CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (source->timer_fd < 0) {
+            msg(INNER_ERROR, "failed to create block timer.");
+        }
+        if (source->command[0] == '@' && pipebar.replay == NULL) {
+            module_open(source);
+        }
+    }
 
-        struct entry entry = {
-            .item = {
-                { .value = "0", .last = &pipebar.part[part_idx] },
-                { .value = "1", .last = &pipebar.part[part_idx] },
-                { .value = "0", .last = &pipebar.part[part_idx] },
-                { .value = NULL, .last = &pipebar.part[part_idx] },
-                { .value = NULL, .last = &pipebar.part[part_idx] },
-                { .value = NULL, .last = &pipebar.part[part_idx] },
-                { .value = NULL, .last = &pipebar.part[part_idx] },
-                { .value = NULL, .last = &pipebar.part[part_idx] },
-                { .value = NULL, .last = &pipebar.part[part_idx] },
-                { .value = NULL, .last = &pipebar.part[part_idx] },
-                { .value = NULL, .last = &pipebar.part[part_idx] },
-            },
-        };
-
-        for (bool escape = false, delimiter = false;
-            !delimiter && (void*)reader < pipebar.text[0].data + pipebar.text[0].size;
-            escape = !escape, reader = reader + strlen(reader) + 1) {
-
-            if (!escape) {
-                struct entry* insert_entry = wl_container_of(pipebar.part[PART_SIZE].prev, insert_entry, link);
-                if (&insert_entry->link == &pipebar.part[PART_SIZE]) {
-                    insert_entry = entry_new();
-                }
-                wl_list_remove(&insert_entry->link);
-                *insert_entry = entry;
-                insert_entry->text = reader;
-                wl_list_insert(&pipebar.part[part_idx], &insert_entry->link);
-            } else {
-                if (reader[0] == 'D') {
-                    delimiter = true;
-                } else if (reader[0] == 'R') {
-                    const char* color_tmp = entry.item[ITEM_BG].value;
-                    entry.item[ITEM_BG].value = entry.item[ITEM_FG].value;
-                    entry.item[ITEM_FG].value = color_tmp;
-                    entry.item[ITEM_BG].last = pipebar.part[part_idx].next;
-                    entry.item[ITEM_FG].last = pipebar.part[part_idx].next;
-                } else {
-                    int item_idx = ITEM_SIZE;
-                    switch (reader[0]) {
-                    case 'B':
-                        item_idx = ITEM_BG;
-                        break;
-                    case 'F':
-                        item_idx = ITEM_FG;
-                        break;
-                    case 'T':
-                        item_idx = ITEM_FONT;
-                        break;
-                    case 'O':
-                        item_idx = ITEM_OUTPUT;
-                        break;
-                    case '1':
-                        item_idx = ITEM_ACT1;
-                        break;
-                    case '2':
-                        item_idx = ITEM_ACT2;
-                        break;
-                    case '3':
-                        item_idx = ITEM_ACT3;
-                        break;
-                    case '4':
-                        item_idx = ITEM_ACT4;
-                        break;
-                    case '5':
-                        item_idx = ITEM_ACT5;
-                        break;
-                    case '6':
-                        item_idx = ITEM_ACT6;
-                        break;
-                    case '7':
-                        item_idx = ITEM_ACT7;
-                        break;
-                    }
-                    if (item_idx == ITEM_SIZE) {
-                        msg(WARNING, "unkown escape characters: %s.\n", reader);
-                        continue;
-                    }
-                    struct item* item = &entry.item[item_idx];
-
-                    if (reader[1] != '\0') {
-                        item->value = reader + 1;
-                        item->last = pipebar.part[part_idx].next;
-                    } else {
-                        if (item->last != &pipebar.part[part_idx]) {
-                            const struct entry* last_entry = wl_container_of(item->last, last_entry, link);
-                            item->value = last_entry->item[item_idx].value;
-                            item->last = last_entry->item[item_idx].last;
-                        } else {
-                            msg(WARNING, "redundant restore operation: %s.", reader);
-                        }
-                    }
+    size_t source_count = pipebar.source.size / sizeof(struct source);
+    source = pipebar.source.data;
+    if (pipebar.layout == NULL) {
+        if (source_count > 1) {
+            msg(RUNTIME_ERROR, "option -p and -e require -l.");
+        }
+        source[0].slot_count = PART_SIZE;
+        for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
+            struct slot* slot = wl_array_add(&pipebar.slot, sizeof(struct slot));
+            slot->part = part_idx;
+        }
+    } else {
+        uint32_t part_idx = PART_LEFT;
+        for (char *head = pipebar.layout, *reader = pipebar.layout;; reader++) {
+            if (reader[0] != ',' && reader[0] != ':' && reader[0] != '\0') continue;
+            if (reader > head) {
+                char* endptr;
+                unsigned long source_idx = strtoul(head, &endptr, 10);
+                if (endptr != reader || source_idx >= source_count || source[source_idx].slot_count != 0) {
+                    msg(RUNTIME_ERROR, "option -l got a invalid input source: %.*s.", (int)(reader - head), head);
                 }
+                source[source_idx].slot = pipebar.slot.size / sizeof(struct slot);
+                source[source_idx].slot_count = 1;
+                struct slot* slot = wl_array_add(&pipebar.slot, sizeof(struct slot));
+                slot->part = part_idx;
+            }
+            if (reader[0] == '\0') break;
+            if (reader[0] == ':' && ++part_idx == PART_SIZE) {
+                msg(RUNTIME_ERROR, "option -l got too many parts.");
             }
+            head = reader + 1;
         }
     }
 
-    struct bar* bar;
-    wl_list_for_each(bar, &pipebar.bar, link)
+    struct slot* slot;
+    wl_array_for_each(slot, &pipebar.slot)
     {
-        bar->redraw = true;
+        wl_array_init(&slot->text);
+        slot->hash = hash(NULL, 0);
+        wl_list_init(&slot->entry);
+    }
+    wl_array_for_each(source, &pipebar.source)
+    {
+        wl_array_init(&source->buffer);
+        wl_array_init(&source->line);
+        source->hash = hash(NULL, 0);
+        if (source->fd < 0) continue;
+        int flags = fcntl(source->fd, F_GETFL);
+        if (flags < 0 || fcntl(source->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+            msg(RUNTIME_ERROR, "failed to set %s non-blocking.", source->name);
+        }
+    }
+
+    struct stat stdout_stat;
+    if (pipebar.exec == 0 && fstat(STDOUT_FILENO, &stdout_stat) == 0 && (S_ISFIFO(stdout_stat.st_mode) || S_ISSOCK(stdout_stat.st_mode))) {
+        pipebar.stdout_flags = fcntl(STDOUT_FILENO, F_GETFL);
+        if (pipebar.stdout_flags < 0 || fcntl(STDOUT_FILENO, F_SETFL, pipebar.stdout_flags | O_NONBLOCK) < 0) {
+            msg(INNER_ERROR, "failed to set STDOUT non-blocking.");
+        }
+        pipebar.stdout_nonblock = true;
     }
 }
 
-static struct canvas* bar_get_canvas(struct bar* bar)
+static uint32_t style_intern(const struct entry* entry)
 {
-    struct canvas* canvas = wl_container_of(bar->canvas.next, canvas, link);
-    if (&canvas->link == &bar->canvas || canvas->busy) {
-        canvas = NULL;
-    } else if (canvas->width != bar->canvas_width || canvas->height != bar->canvas_height) {
-        canvas_destroy(canvas);
-        canvas = NULL;
-    }
-    if (canvas == NULL) {
-        canvas = canvas_new(bar);
-        wl_buffer_add_listener(canvas->wl_buffer, &wl_buffer_listener, canvas);
+    struct style* style;
+    wl_array_for_each(style, &pipebar.style)
+    {
+        if (style->bg == entry->item[ITEM_BG].index && style->fg == entry->item[ITEM_FG].index && style->font == entry->item[ITEM_FONT].index) {
+            return style - (struct style*)pipebar.style.data;
+        }
     }
-    return canvas;
+    style = wl_array_add(&pipebar.style, sizeof(struct style));
+    style->bg = entry->item[ITEM_BG].index;
+    style->fg = entry->item[ITEM_FG].index;
+    style->font = entry->item[ITEM_FONT].index;
+    return pipebar.style.size / sizeof(struct style) - 1;
 }
 
-static void draw(struct bar* bar)
+static void parse_index(struct item* item, int item_idx)
 {
-    struct canvas* canvas = bar_get_canvas(bar);
-
-    for (int part_idx = 0; part_idx < PART_SIZE; part_idx++) {
-        struct block *block, *block_tmp;
-        wl_list_for_each_reverse_safe(block, block_tmp, &bar->part[part_idx], link)
-        {
-            wl_list_remove(&block->link);
-            fcft_text_run_destroy(block->run);
-            block->run = NULL;
-            wl_list_insert(&bar->part[PART_SIZE], &block->link);
+    static const char* const name[] = { "bg color", "fg color", "font" };
+    static const uint32_t fallback[] = { 0, 1, 0 };
+    char* endptr;
+    unsigned long index = strtoul(item->value, &endptr, 10);
+    size_t count = item_idx == ITEM_FONT ? pipebar.font.size / sizeof(char*) : pipebar.color.size / sizeof(pixman_color_t);
+    if (*endptr != '\0' || index >= count) {
+        if (!(pipebar.warned & (1 << item_idx))) {
+            msg(WARNING, "%s index %s is out of range. fallback to %u.", name[item_idx], item->value, fallback[item_idx]);
+            pipebar.warned |= 1 << item_idx;
         }
+        index = fallback[item_idx];
     }
+    item->index = index;
+}
 
-    struct fcft_font** font = bar->font.data;
-    pixman_color_t* color = pipebar.color.data;
+static void parse_slot(struct slot* slot)
+{
+    struct entry *old_entry, *old_entry_tmp;
+    wl_list_for_each_reverse_safe(old_entry, old_entry_tmp, &slot->entry, link)
+    {
+        wl_list_remove(&old_entry->link);
+        wl_list_insert(&pipebar.entry, &old_entry->link);
+    }
 
-    pixman_box32_t bar_box = { 0, 0, canvas->width, canvas->height };
-    pixman_image_fill_boxes(PIXMAN_OP_SRC, canvas->image, color, 1, &bar_box);
-    pixman_image_t* bar_fg_image = pixman_image_create_solid_fill(color + 1);
-    for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
-        uint32_t part_width = 0;
-        struct entry* entry;
-        struct block* block;
-        wl_list_for_each_reverse(entry, &pipebar.part[part_idx], link)
-        {
-            if (entry->text[0] == '\0') continue;
-            if (entry->item[ITEM_OUTPUT].value != NULL) {
-                struct entry* each = entry;
-                do {
-                    if (strcmp(each->item[ITEM_OUTPUT].value, bar->name) == 0) break;
-                    each = wl_container_of(each->item[ITEM_OUTPUT].last, each, link);
-                } while (each->item[ITEM_OUTPUT].value != NULL);
-                if (each->item[ITEM_OUTPUT].value == NULL) continue;
-            }
+    struct entry entry = {
+        .item = {
+            { .value = "0", .index = 0, .last = &slot->entry },
+            { .value = "1", .index = 1, .last = &slot->entry },
+            { .value = "0", .index = 0, .last = &slot->entry },
+            { .value = NULL, .last = &slot->entry },
+            { .value = NULL, .last = &slot->entry },
+            { .value = NULL, .last = &slot->entry },
+            { .value = NULL, .last = &slot->entry },
+            { .value = NULL, .last = &slot->entry },
+            { .value = NULL, .last = &slot->entry },
+            { .value = NULL, .last = &slot->entry },
+            { .value = NULL, .last = &slot->entry },
+        },
+    };
 
-            block = wl_container_of(bar->part[PART_SIZE].prev, block, link);
-            if (&block->link == &bar->part[PART_SIZE]) {
-                block = block_new(bar);
-            }
+    const char* reader = slot->text.data;
+    for (bool escape = false;
+        (void*)reader < slot->text.data + slot->text.size;
+        escape = !escape, reader = reader + strlen(reader) + 1) {
 
-            wl_list_remove(&block->link);
-            wl_list_insert(&bar->part[part_idx], &block->link);
-            block->entry = entry;
-
-            int bg_idx = strtoul(entry->item[ITEM_BG].value, NULL, 10);
-            if ((void*)(color + bg_idx) >= pipebar.color.data + pipebar.color.size) {
-                msg(WARNING, "bg color index %ud is out of range. fallback to 0.", bg_idx);
-                bg_idx = 0;
-            }
-            block->bg = color + bg_idx;
-
-            int fg_idx = strtoul(entry->item[ITEM_FG].value, NULL, 10);
-            if ((void*)(color + fg_idx) >= pipebar.color.data + pipebar.color.size) {
-                msg(WARNING, "fg color index %ud is out of range. fallback to 1.", fg_idx);
-                fg_idx = 1;
-            }
-            block->fg = color + fg_idx;
-
-            int font_idx = strtoul(entry->item[ITEM_FONT].value, NULL, 10);
-            if ((void*)(font + font_idx) >= bar->font.data + bar->font.size) {
-                msg(WARNING, "font index %ud is out of range. fallback to 0.", font_idx);
-                font_idx = 0;
-            }
-            block->font = font[font_idx];
-
-            block->y = (canvas->height - block->font->height) / 2;
-            block->height = block->font->height;
-            block->base = (block->font->height + block->font->descent + block->font->ascent) / 2 - (block->font->descent > 0 ? block->font->descent : 0);
-
-            pipebar.codepoint.size = 0;
-            const char* reader = entry->text;
-            while (reader[0] != '\0') {
-                uint32_t* codepoint = wl_array_add(&pipebar.codepoint, 4);
-                if ((reader[0] & 0b10000000) == 0b00000000) {
-                    *codepoint = reader[0];
-                    reader += 1;
-                } else if ((reader[0] & 0b11100000) == 0b11000000) {
-                    if ((reader[1] & 0b11000000) != 0b10000000) {
-                        msg(RUNTIME_ERROR, "invalid utf-8 character sequence.");
-                    }
-                    *codepoint = ((reader[0] & 0b11111) << 6) | (reader[1] & 0b111111);
-                    reader += 2;
-                } else if ((reader[0] & 0b11110000) == 0b11100000) {
-                    if ((reader[1] & 0b11000000) != 0b10000000 || (reader[2] & 0b11000000) != 0b10000000) {
-                        msg(RUNTIME_ERROR, "invalid utf-8 character sequence.");
-                    }
-                    *codepoint = ((reader[0] & 0b1111) << 12) | ((reader[1] & 0b111111) << 6) | (reader[2] & 0b111111);
-                    reader += 3;
-                } else if ((reader[0] & 0b11111000) == 0b11110000) {
-                    if ((reader[1] & 0b11000000) != 0b10000000 || (reader[2] & 0b11000000) != 0b10000000 || (reader[3] & 0b11000000) != 0b10000000) {
-                        msg(RUNTIME_ERROR, "invalid utf-8 character sequence.");
-                    }
-                    *codepoint = ((reader[0] & 0b111) << 18) | ((reader[1] & 0b111111) << 12) | ((reader[2] & 0b111111) << 6) | (reader[3] & 0b111111);
-                    reader += 4;
-                } else {
-                    msg(RUNTIME_ERROR, "invalid utf-8 character sequence.");
-                }
+        if (!escape) {
+            struct entry* insert_entry = wl_container_of(pipebar.entry.prev, insert_entry, link);
+            if (&insert_entry->link == &pipebar.entry) {
+                insert_entry = entry_new();
             }
-            block->run = fcft_rasterize_text_run_utf32(block->font, pipebar.codepoint.size / 4, pipebar.codepoint.data, FCFT_SUBPIXEL_DEFAULT);
-            block->width = 0;
-            for (int i = 0; i < block->run->count; i++) {
-                block->width += block->run->glyphs[i]->advance.x;
+            wl_list_remove(&insert_entry->link);
+            *insert_entry = entry;
+            insert_entry->style = style_intern(&entry);
+            insert_entry->output = entry.item[ITEM_OUTPUT].value == NULL ? UINT32_MAX : entry.item[ITEM_OUTPUT].index;
+            insert_entry->text = reader;
+            wl_list_insert(&slot->entry, &insert_entry->link);
+        } else if (reader[0] == 'R') {
+            const struct item color_tmp = entry.item[ITEM_BG];
+            entry.item[ITEM_BG] = entry.item[ITEM_FG];
+            entry.item[ITEM_FG] = color_tmp;
+            entry.item[ITEM_BG].last = slot->entry.next;
+            entry.item[ITEM_FG].last = slot->entry.next;
+        } else {
+            int item_idx = ITEM_SIZE;
+            switch (reader[0]) {
+            case 'B':
+                item_idx = ITEM_BG;
+                break;
+            case 'F':
+                item_idx = ITEM_FG;
+                break;
+            case 'T':
+                item_idx = ITEM_FONT;
+                break;
+            case 'O':
+                item_idx = ITEM_OUTPUT;
+                break;
+            case '1':
+                item_idx = ITEM_ACT1;
+                break;
+            case '2':
+                item_idx = ITEM_ACT2;
+                break;
+            case '3':
+                item_idx = ITEM_ACT3;
+                break;
+            case '4':
+                item_idx = ITEM_ACT4;
+                break;
+            case '5':
+                item_idx = ITEM_ACT5;
+                break;
+            case '6':
+                item_idx = ITEM_ACT6;
+                break;
+            case '7':
+                item_idx = ITEM_ACT7;
+                break;
             }
-            part_width += block->width;
-        }
-        if (part_width == 0) continue;
-        uint32_t x = part_idx == PART_LEFT ? 0 : (part_idx == PART_RIGHT ? (canvas->width - part_width) : ((canvas->width - part_width) / 2));
-        wl_list_for_each_reverse(block, &bar->part[part_idx], link)
-        {
-            block->x = x;
-
-            if (block->bg != color) {
-                pixman_box32_t block_box = { block->x, block->y, block->x + block->width, block->y + block->height };
-                pixman_image_fill_boxes(PIXMAN_OP_SRC, canvas->image, block->bg, 1, &block_box);
+            if (item_idx == ITEM_SIZE) {
+                msg(WARNING, "unkown escape characters: %s.\n", reader);
+                continue;
             }
-
-            for (int j = 0; j < block->run->count; j++) {
-                const struct fcft_glyph* glyph = block->run->glyphs[j];
-                if (glyph->is_color_glyph) {
-                    pixman_image_composite32(PIXMAN_OP_OVER, glyph->pix, NULL, canvas->image, 0, 0, 0, 0, x + glyph->x, block->base + block->y - glyph->y, glyph->width, glyph->height);
+            struct item* item = &entry.item[item_idx];
+
+            if (reader[1] != '\0') {
+                item->value = reader + 1;
+                item->last = slot->entry.next;
+                if (item_idx <= ITEM_FONT) {
+                    parse_index(item, item_idx);
+                } else if (item_idx == ITEM_OUTPUT) {
+                    const struct entry* last_entry = wl_container_of(item->last, last_entry, link);
+                    item->index = output_intern(item->value) | (item->last != &slot->entry ? last_entry->item[ITEM_OUTPUT].index : 0);
+                }
+            } else {
+                if (item->last != &slot->entry) {
+                    const struct entry* last_entry = wl_container_of(item->last, last_entry, link);
+                    item->value = last_entry->item[item_idx].value;
+                    item->index = last_entry->item[item_idx].index;
+                    item->last = last_entry->item[item_idx].last;
                 } else {
-                    pixman_image_t* block_fg_image;
-                    if (block->fg != color + 1) {
-                        block_fg_image = pixman_image_create_solid_fill(block->fg);
-                    } else {
-                        block_fg_image = pixman_image_ref(bar_fg_image);
-                    }
-                    pixman_image_composite32(PIXMAN_OP_OVER, block_fg_image, glyph->pix, canvas->image, 0, 0, 0, 0, x + glyph->x, block->base + block->y - glyph->y, glyph->width, glyph->height);
-                    pixman_image_unref(block_fg_image);
+                    msg(WARNING, "redundant restore operation: %s.", reader);
                 }
-                x += glyph->advance.x;
             }
         }
     }
+}
 
-    pixman_image_unref(bar_fg_image);
-
-    wl_surface_set_buffer_scale(bar->wl_surface, 1);
-    wl_surface_attach(bar->wl_surface, canvas->wl_buffer, 0, 0);
-    wl_surface_damage(bar->wl_surface, 0, 0, INT32_MAX, INT32_MAX);
-    wl_surface_commit(bar->wl_surface);
-    canvas->busy = true;
-
+static void parse_segment(struct slot* slot, const char* head, const char* tail)
+{
+    uint64_t slot_hash = hash(head, tail - head);
+    if (slot_hash == slot->hash && slot->text.size == tail - head && memcmp(slot->text.data, head, tail - head) == 0) return;
+    slot->hash = slot_hash;
+    slot->text.size = 0;
+    memcpy(wl_array_add(&slot->text, tail - head), head, tail - head);
+    parse_slot(slot);
+
+    uint64_t parse_time = pipebar.debug ? now() : 0;
+    struct bar* bar;
+    wl_list_for_each(bar, &pipebar.bar, link)
+    {
+        bar->dirty |= 1 << slot->part;
+        bar->redraw = true;
+        if (pipebar.debug && bar->trace[TRACE_LINE] == 0) {
+            bar->trace[TRACE_LINE] = pipebar.line_time;
+            bar->trace[TRACE_PARSE] = parse_time;
+        }
+    }
+}
+
+static void parse_frame(struct source* source, const char* frame, uint32_t frame_len)
+{
+    pipebar.warned = 0;
+    if (pipebar.debug) pipebar.line_time = now();
+    if (pipebar.record != NULL) record(source, frame, frame_len);
+    uint16_t segment;
+    if (frame_len < sizeof(segment)) {
+        msg(WARNING, "got a truncated frame.");
+        return;
+    }
+    memcpy(&segment, frame, sizeof(segment));
+    segment = le16toh(segment);
+    if (segment >= source->slot_count) {
+        msg(WARNING, "frame segment %u is out of range.", segment);
+        return;
+    }
+
+    struct wl_array* text = &pipebar.frame;
+    text->size = 0;
+    const char* end = frame + frame_len;
+    for (const char* reader = frame + sizeof(segment); reader < end;) {
+        uint8_t type = reader[0];
+        uint16_t payload_len;
+        if (end - reader < 4) {
+            msg(WARNING, "got a truncated frame field.");
+            return;
+        }
+        memcpy(&payload_len, reader + 2, sizeof(payload_len));
+        payload_len = le16toh(payload_len);
+        const char* payload = reader + 4;
+        reader = payload + payload_len;
+        if (reader > end) {
+            msg(WARNING, "got a truncated frame field.");
+            return;
+        } else if (type != 'B' && type != 'F' && type != 'T' && memchr(payload, '\0', payload_len) != NULL) {
+            msg(WARNING, "got a frame field containing NUL.");
+            return;
+        }
+
+        if (type == 0) {
+            memcpy(wl_array_add(text, payload_len), payload, payload_len);
+            continue;
+        } else if (strchr("BFTO1234567R", type) == NULL || (type == 'R' && payload_len != 0)) {
+            msg(WARNING, "got an invalid frame field type %u.", type);
+            return;
+        }
+        *(char*)wl_array_add(text, 1) = '\0';
+        if (type == 'B' || type == 'F' || type == 'T') {
+            uint16_t index;
+            if (payload_len == sizeof(index)) {
+                memcpy(&index, payload, sizeof(index));
+                text->size += sprintf(wl_array_add(text, 8), "%c%u", type, le16toh(index)) - 8;
+            } else if (payload_len == 0) {
+                *(char*)wl_array_add(text, 1) = type;
+            } else {
+                msg(WARNING, "got an invalid frame index field.");
+                return;
+            }
+        } else {
+            *(char*)wl_array_add(text, 1) = type;
+            memcpy(wl_array_add(text, payload_len), payload, payload_len);
+        }
+        *(char*)wl_array_add(text, 1) = '\0';
+    }
+    *(char*)wl_array_add(text, 1) = '\0';
+
+    parse_segment((struct slot*)pipebar.slot.data + source->slot + segment, text->data, (char*)text->data + text->size);
+}
+
+static void parse(struct source* source, const char* reader, const char* end)
+{
+    pipebar.warned = 0;
+    for (uint32_t slot_idx = source->slot; slot_idx < source->slot + source->slot_count; slot_idx++) {
+        const char* head = reader;
+        const char* tail = end;
+        for (bool escape = false; reader < end; escape = !escape) {
+            const char* chunk = reader;
+            reader = reader + strlen(reader) + 1;
+            if (escape && chunk[0] == 'D') {
+                tail = chunk;
+                break;
+            }
+        }
+
+        parse_segment((struct slot*)pipebar.slot.data + slot_idx, head, tail);
+    }
+    if (reader < end) {
+        msg(WARNING, "too many delimiters.");
+    }
+}
+
+static struct canvas* bar_get_canvas(struct bar* bar)
+{
+    struct canvas *canvas, *canvas_tmp, *free_canvas = NULL;
+    uint32_t canvas_count = 0;
+    wl_list_for_each_safe(canvas, canvas_tmp, &bar->canvas, link)
+    {
+        if (!canvas->busy && (canvas->width != bar->canvas_width || canvas->height != bar->canvas_height)) {
+            canvas_destroy(canvas);
+            continue;
+        }
+        canvas_count++;
+        if (!canvas->busy && (free_canvas == NULL || canvas->frame > free_canvas->frame)) {
+            free_canvas = canvas;
+        }
+    }
+    if (free_canvas != NULL) return free_canvas;
+
+    if (canvas_count >= pipebar.depth) {
+        bar->pool_starve++;
+        return NULL;
+    }
+    free_canvas = canvas_new(bar);
+    if (free_canvas->wl_buffer != NULL) wl_buffer_add_listener(free_canvas->wl_buffer, &wl_buffer_listener, free_canvas);
+    return free_canvas;
+}
+
+static int hit_compare(const void* a, const void* b)
+{
+    const struct hit* hit_a = a;
+    const struct hit* hit_b = b;
+    return hit_a->x < hit_b->x ? -1 : hit_a->x > hit_b->x;
+}
+
+static struct hitmap* hitmap_new(struct bar* bar, const struct canvas* canvas)
+{
+    size_t count = 0, text_size = 0;
+    for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
+        struct block* block;
+        wl_list_for_each(block, &bar->part[part_idx], link)
+        {
+            bool has_action = false;
+            for (int item_idx = ITEM_ACT1; item_idx < ITEM_SIZE; item_idx++) {
+                if (block->entry->item[item_idx].value == NULL) continue;
+                text_size += strlen(block->entry->item[item_idx].value) + 1;
+                has_action = true;
+            }
+            if (has_action && block->width != 0) count++;
+        }
+    }
+
+    struct hitmap* hitmap = malloc(sizeof(struct hitmap) + count * sizeof(struct hit) + text_size);
+    hitmap->width = canvas->width;
+    hitmap->height = canvas->height;
+    hitmap->surface_width = bar->width;
+    hitmap->surface_height = pipebar.height;
+    hitmap->count = count;
+    char* text = (char*)&hitmap->hit[count];
+    struct hit* hit = hitmap->hit;
+    for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
+        struct block* block;
+        wl_list_for_each_reverse(block, &bar->part[part_idx], link)
+        {
+            bool has_action = false;
+            for (int item_idx = ITEM_ACT1; item_idx < ITEM_SIZE; item_idx++) {
+                has_action |= block->entry->item[item_idx].value != NULL;
+            }
+            if (!has_action || block->width == 0) continue;
+            *hit = (struct hit) { block->x, block->y, block->width, block->height };
+            for (int item_idx = ITEM_ACT1; item_idx < ITEM_SIZE; item_idx++) {
+                const char* action = block->entry->item[item_idx].value;
+                if (action == NULL) continue;
+                size_t action_len = strlen(action) + 1;
+                hit->action[item_idx - ITEM_ACT1] = memcpy(text, action, action_len);
+                text += action_len;
+            }
+            hit++;
+        }
+    }
+
+    // parts may overlap on a narrow bar, clip each rect at the start of the next one.
+    qsort(hitmap->hit, count, sizeof(struct hit), hit_compare);
+    for (size_t i = 1; i < count; i++) {
+        struct hit* prev = &hitmap->hit[i - 1];
+        if (prev->x + prev->width > hitmap->hit[i].x) {
+            prev->width = hitmap->hit[i].x - prev->x;
+        }
+    }
+    return hitmap;
+}
+
+static bool layout(struct bar* bar)
+{
+    struct canvas* canvas = bar_get_canvas(bar);
+    if (canvas == NULL) return false;
+
+    for (int part_idx = 0; part_idx < PART_SIZE; part_idx++) {
+        if (!(bar->dirty & (1 << part_idx))) continue;
+        struct block *block, *block_tmp;
+        wl_list_for_each_reverse_safe(block, block_tmp, &bar->part[part_idx], link)
+        {
+            wl_list_remove(&block->link);
+            run_put(block->run);
+            block->run = NULL;
+            wl_list_insert(&bar->part[PART_SIZE], &block->link);
+        }
+    }
+
+    struct font** font = bar->font.data;
+    pixman_color_t* color = pipebar.color.data;
+
+    pixman_region32_t* damage = &bar->damage[(bar->frame + 1) % DAMAGE_SIZE];
+    pixman_region32_clear(damage);
+    if (bar->dirty & (1 << PART_SIZE)) {
+        pixman_region32_union_rect(damage, damage, 0, 0, canvas->width, canvas->height);
+    }
+
+    for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
+        uint32_t part_width = 0;
+        struct entry* entry;
+        struct block* block;
+        wl_list_for_each(block, &bar->part[part_idx], link)
+        {
+            part_width += block->width;
+        }
+        struct slot* slot;
+        wl_array_for_each(slot, &pipebar.slot)
+        {
+            if (slot->part != part_idx || !(bar->dirty & (1 << part_idx))) continue;
+            wl_list_for_each_reverse(entry, &slot->entry, link)
+            {
+                if (entry->text[0] == '\0') continue;
+                if (!(entry->output & bar->output)) continue;
+
+                block = wl_container_of(bar->part[PART_SIZE].prev, block, link);
+                if (&block->link == &bar->part[PART_SIZE]) {
+                    block = block_new(bar);
+                }
+
+                wl_list_remove(&block->link);
+                wl_list_insert(&bar->part[part_idx], &block->link);
+                block->entry = entry;
+
+                const struct style* style = (struct style*)pipebar.style.data + entry->style;
+                block->bg = color + style->bg;
+                block->fg = color + style->fg;
+                if (font[style->font] == NULL) {
+                    font[style->font] = font_get(((char**)pipebar.font.data)[style->font], 96 * bar->scale / 120);
+                }
+                block->font = font[style->font]->fcft_font;
+
+                block->y = block->font->height < canvas->height ? (canvas->height - block->font->height) / 2 : 0;
+                block->height = block->font->height;
+                block->base = (block->font->height + block->font->descent + block->font->ascent) / 2 - (block->font->descent > 0 ? block->font->descent : 0);
+
+                size_t text_len = strlen(entry->text);
+                pipebar.codepoint.size = 0;
+                wl_array_add(&pipebar.codepoint, text_len * 4);
+                pipebar.codepoint.size = utf8_decode(entry->text, text_len, pipebar.codepoint.data) * 4;
+                block->run = run_get(block->font, pipebar.codepoint.data, pipebar.codepoint.size / 4);
+                block->width = block->run->width;
+                part_width += block->width;
+            }
+        }
+        uint32_t x = part_idx == PART_LEFT ? 0 : (part_idx == PART_RIGHT ? (canvas->width - part_width) : ((canvas->width - part_width) / 2));
+        struct wl_array* layout = &bar->layout[part_idx];
+        size_t rect_idx = 0;
+        wl_list_for_each_reverse(block, &bar->part[part_idx], link)
+        {
+            block->x = x;
+            x += block->width;
+
+            struct rect block_rect = { block->x, block->y, block->width, block->height, block->run->hash, block->entry->style };
+            struct rect* rect;
+            if (rect_idx < layout->size / sizeof(struct rect)) {
+                rect = (struct rect*)layout->data + rect_idx;
+                if (!rect_equal(rect, &block_rect)) {
+                    damage_rect(damage, rect);
+                    damage_rect(damage, &block_rect);
+                }
+            } else {
+                rect = wl_array_add(layout, sizeof(struct rect));
+                damage_rect(damage, &block_rect);
+            }
+            *rect = block_rect;
+            rect_idx++;
+        }
+        for (struct rect* rect = (struct rect*)layout->data + rect_idx; (void*)rect < layout->data + layout->size; rect++) {
+            damage_rect(damage, rect);
+        }
+        layout->size = rect_idx * sizeof(struct rect);
+    }
+
+    pixman_region32_intersect_rect(damage, damage, 0, 0, canvas->width, canvas->height);
+    free(bar->hitmap);
+    bar->hitmap = hitmap_new(bar, canvas);
+    bar->dirty = 0;
     bar->redraw = false;
+    if (!pixman_region32_not_empty(damage)) {
+        bar->trace[TRACE_LINE] = 0;
+        return false;
+    }
+
+    pixman_region32_clear(&bar->repaint);
+    if (canvas->frame == 0 || bar->frame + 1 - canvas->frame > DAMAGE_SIZE) {
+        pixman_region32_union_rect(&bar->repaint, &bar->repaint, 0, 0, canvas->width, canvas->height);
+    } else {
+        for (uint64_t frame = canvas->frame + 1; frame <= bar->frame + 1; frame++) {
+            pixman_region32_union(&bar->repaint, &bar->repaint, &bar->damage[frame % DAMAGE_SIZE]);
+        }
+    }
+    bar->pending = canvas;
+    if (bar->trace[TRACE_LINE] != 0) bar->trace[TRACE_SHAPE] = now();
+    return true;
+}
+
+// render() runs on worker threads, it must not call into fcft nor touch state shared with other bars.
+static void render(struct bar* bar)
+{
+    struct canvas* canvas = bar->pending;
+    pixman_color_t* color = pipebar.color.data;
+    pixman_image_set_clip_region32(canvas->image, &bar->repaint);
+
+    pixman_box32_t bar_box = { 0, 0, canvas->width, canvas->height };
+    pixman_image_fill_boxes(PIXMAN_OP_SRC, canvas->image, color, 1, &bar_box);
+    pixman_image_t** fill = pipebar.fill.data;
+    pixman_glyph_cache_freeze(bar->glyph_cache);
+    for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
+        struct block* block;
+        wl_list_for_each_reverse(block, &bar->part[part_idx], link)
+        {
+            if (block->x + block->width + block->height <= bar->repaint.extents.x1 || block->x >= bar->repaint.extents.x2 + block->height) continue;
+
+            if (block->bg != color) {
+                pixman_box32_t block_box = { block->x, block->y, block->x + block->width, block->y + block->height };
+                pixman_image_fill_boxes(PIXMAN_OP_SRC, canvas->image, block->bg, 1, &block_box);
+            }
+
+            bar->glyph.size = 0;
+            uint32_t x = block->x;
+            for (int j = 0; j < block->run->text_run->count; j++) {
+                const struct fcft_glyph* glyph = block->run->text_run->glyphs[j];
+                if (glyph->is_color_glyph) {
+                    pixman_image_composite32(PIXMAN_OP_OVER, glyph->pix, NULL, canvas->image, 0, 0, 0, 0, x + glyph->x, block->base + block->y - glyph->y, glyph->width, glyph->height);
+                } else if (pixman_image_get_format(glyph->pix) != PIXMAN_a8) {
+                    pixman_image_composite32(PIXMAN_OP_OVER, fill[block->fg - color], glyph->pix, canvas->image, 0, 0, 0, 0, x + glyph->x, block->base + block->y - glyph->y, glyph->width, glyph->height);
+                } else {
+                    const void* cached = pixman_glyph_cache_lookup(bar->glyph_cache, block->run, (void*)glyph);
+                    if (cached == NULL) {
+                        cached = pixman_glyph_cache_insert(bar->glyph_cache, block->run, (void*)glyph, -glyph->x, glyph->y, glyph->pix);
+                    }
+                    pixman_glyph_t* pixman_glyph = wl_array_add(&bar->glyph, sizeof(pixman_glyph_t));
+                    *pixman_glyph = (pixman_glyph_t) { x, block->base + block->y, cached };
+                }
+                x += glyph->advance.x;
+            }
+            if (bar->glyph.size != 0) {
+                pixman_composite_glyphs_no_mask(PIXMAN_OP_OVER, fill[block->fg - color], canvas->image, 0, 0, 0, 0, bar->glyph_cache, bar->glyph.size / sizeof(pixman_glyph_t), bar->glyph.data);
+            }
+        }
+    }
+    pixman_glyph_cache_thaw(bar->glyph_cache);
+    pixman_image_set_clip_region32(canvas->image, NULL);
+    if (bar->trace[TRACE_LINE] != 0) bar->trace[TRACE_COMPOSITE] = now();
+}
+
+static void commit(struct bar* bar)
+{
+    struct canvas* canvas = bar->pending;
+    pixman_region32_t* damage = &bar->damage[(bar->frame + 1) % DAMAGE_SIZE];
+
+    wl_surface_set_buffer_scale(bar->wl_surface, 1);
+    wl_surface_attach(bar->wl_surface, canvas->wl_buffer, 0, 0);
+    int box_count;
+    pixman_box32_t* box = pixman_region32_rectangles(damage, &box_count);
+    for (int i = 0; i < box_count; i++) {
+        wl_surface_damage_buffer(bar->wl_surface, box[i].x1, box[i].y1, box[i].x2 - box[i].x1, box[i].y2 - box[i].y1);
+    }
+    bar->wl_callback = wl_surface_frame(bar->wl_surface);
+    wl_callback_add_listener(bar->wl_callback, &wl_callback_listener, bar);
+    if (bar->trace[TRACE_LINE] != 0) {
+        bar->trace[TRACE_COMMIT] = now();
+        if (pipebar.wp_presentation != NULL) {
+            struct trace* trace = calloc(1, sizeof(struct trace));
+            memcpy(trace->time, bar->trace, sizeof(trace->time));
+            trace->wp_presentation_feedback = wp_presentation_feedback(pipebar.wp_presentation, bar->wl_surface);
+            wp_presentation_feedback_add_listener(trace->wp_presentation_feedback, &wp_presentation_feedback_listener, trace);
+            wl_list_insert(&pipebar.trace, &trace->link);
+        } else {
+            trace_record(bar->trace);
+        }
+        memset(bar->trace, 0, sizeof(bar->trace));
+    }
+    wl_surface_commit(bar->wl_surface);
+    canvas->busy = true;
+    bar->pending = NULL;
+
+    bar->frame++;
+    canvas->frame = bar->frame;
+    if (pipebar.startup_time[3] == 0) {
+        pipebar.startup_time[3] = now();
+        if (pipebar.debug) {
+            msg(WARNING, "startup: wayland %.1fms, fonts %.1fms, first frame %.1fms.",
+                (pipebar.startup_time[1] - pipebar.startup_time[0]) / 1e6,
+                (pipebar.startup_time[2] - pipebar.startup_time[0]) / 1e6,
+                (pipebar.startup_time[3] - pipebar.startup_time[0]) / 1e6);
+        }
+    }
+    bar->time = now();
 }
 
 pixman_color_t strtocolor(const char* const str)
@@ -1159,9 +2592,59 @@ pixman_color_t strtocolor(const char* const str)
 char default_colors[] = "000000ff,ffffffff";
 char default_fonts[] = "monospace";
 
+static void* worker(void* data)
+{
+    pthread_mutex_lock(&pipebar.job_mutex);
+    while (true) {
+        while (!pipebar.job_quit && pipebar.job_next == pipebar.job_count) {
+            pthread_cond_wait(&pipebar.job_cond, &pipebar.job_mutex);
+        }
+        if (pipebar.job_quit) break;
+        struct bar* bar = ((struct bar**)pipebar.job.data)[pipebar.job_next++];
+        pthread_mutex_unlock(&pipebar.job_mutex);
+        render(bar);
+        pthread_mutex_lock(&pipebar.job_mutex);
+        if (++pipebar.job_done == pipebar.job_count) {
+            pthread_cond_signal(&pipebar.job_done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pipebar.job_mutex);
+    return NULL;
+}
+
+static void render_jobs()
+{
+    size_t job_count = pipebar.job.size / sizeof(struct bar*);
+    struct bar** job = pipebar.job.data;
+    if (pipebar.worker.size == 0 || job_count == 1) {
+        for (size_t i = 0; i < job_count; i++) {
+            render(job[i]);
+        }
+        return;
+    }
+
+    pthread_mutex_lock(&pipebar.job_mutex);
+    pipebar.job_count = job_count;
+    pipebar.job_next = 0;
+    pipebar.job_done = 0;
+    pthread_cond_broadcast(&pipebar.job_cond);
+    while (pipebar.job_next < pipebar.job_count) {
+        struct bar* bar = job[pipebar.job_next++];
+        pthread_mutex_unlock(&pipebar.job_mutex);
+        render(bar);
+        pthread_mutex_lock(&pipebar.job_mutex);
+        pipebar.job_done++;
+    }
+    while (pipebar.job_done < pipebar.job_count) {
+        pthread_cond_wait(&pipebar.job_done_cond, &pipebar.job_mutex);
+    }
+    pthread_mutex_unlock(&pipebar.job_mutex);
+}
+
 static void init(int argc, char** argv)
 {
     pipebar_init();
+    pipebar.startup_time[0] = now();
 
     pipebar.version = "3.3";
 
@@ -1169,9 +2652,14 @@ static void init(int argc, char** argv)
     pipebar.fonts = default_fonts;
     pipebar.outputs = NULL;
     pipebar.seats = NULL;
+    pipebar.pipes = NULL;
+    pipebar.layout = NULL;
     pipebar.bottom = false;
     pipebar.gap = 0;
     pipebar.throttle = 100;
+    pipebar.fps = 0;
+    pipebar.depth = 3;
+    pipebar.jobs = 1;
     pipebar.replace = "{}";
 
     for (int i = 1; i < argc; i++) {
@@ -1199,8 +2687,40 @@ static void init(int argc, char** argv)
             } else {
                 msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
             }
+        } else if (strcmp(argv[i], "-p") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                pipebar.pipes = argv[i];
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+        } else if (strcmp(argv[i], "-e") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                *(char**)wl_array_add(&pipebar.command, sizeof(char*)) = argv[i];
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+        } else if (strcmp(argv[i], "-l") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                pipebar.layout = argv[i];
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+        } else if (strcmp(argv[i], "-a") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                char* endptr;
+                pipebar.exec = strtoul(argv[i], &endptr, 10);
+                if (*endptr != '\0') {
+                    msg(RUNTIME_ERROR, "option %s got a invalid argument: %s.", argv[i - 1], argv[i]);
+                }
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
         } else if (strcmp(argv[i], "-b") == 0) {
             pipebar.bottom = true;
+        } else if (strcmp(argv[i], "-d") == 0) {
+            pipebar.debug = true;
+        } else if (strcmp(argv[i], "-x") == 0) {
+            pipebar.binary = true;
         } else if (strcmp(argv[i], "-g") == 0) {
             if (++i < argc && argv[i][0] != '\0') {
                 char* endptr;
@@ -1221,6 +2741,75 @@ static void init(int argc, char** argv)
             } else {
                 msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
             }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                char* endptr;
+                pipebar.fps = strtoul(argv[i], &endptr, 10);
+                if (*endptr != '\0') {
+                    msg(RUNTIME_ERROR, "option %s got a invalid argument: %s.", argv[i - 1], argv[i]);
+                }
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+        } else if (strcmp(argv[i], "-j") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                char* endptr;
+                pipebar.jobs = strtoul(argv[i], &endptr, 10);
+                if (*endptr != '\0' || pipebar.jobs == 0) {
+                    msg(RUNTIME_ERROR, "option %s got a invalid argument: %s.", argv[i - 1], argv[i]);
+                }
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+        } else if (strcmp(argv[i], "-n") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                char* endptr;
+                pipebar.depth = strtoul(argv[i], &endptr, 10);
+                if (*endptr != '\0' || pipebar.depth == 0) {
+                    msg(RUNTIME_ERROR, "option %s got a invalid argument: %s.", argv[i - 1], argv[i]);
+                }
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+        } else if (strcmp(argv[i], "-q") == 0) {
+            if (++i < argc && strcmp(argv[i], "drop") == 0) {
+                pipebar.policy = POLICY_DROP;
+            } else if (i < argc && strcmp(argv[i], "coalesce") == 0) {
+                pipebar.policy = POLICY_COALESCE;
+            } else if (i < argc) {
+                msg(RUNTIME_ERROR, "option %s got a invalid argument: %s.", argv[i - 1], argv[i]);
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+        } else if (strcmp(argv[i], "--record") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                pipebar.record = fopen(argv[i], "w");
+                if (pipebar.record == NULL) {
+                    msg(RUNTIME_ERROR, "failed to open record file %s.", argv[i]);
+                }
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            if (++i < argc && argv[i][0] != '\0') {
+                pipebar.replay_speed = 1;
+                char* speed = strrchr(argv[i], ':');
+                if (speed != NULL) {
+                    char* endptr;
+                    speed[0] = '\0';
+                    pipebar.replay_speed = strtod(speed + 1, &endptr);
+                    if (speed[1] == '\0' || *endptr != '\0' || pipebar.replay_speed < 0) {
+                        msg(RUNTIME_ERROR, "option %s got a invalid speed: %s.", argv[i - 1], speed + 1);
+                    }
+                }
+                pipebar.replay = fopen(argv[i], "r");
+                if (pipebar.replay == NULL) {
+                    msg(RUNTIME_ERROR, "failed to open record file %s.", argv[i]);
+                }
+                pipebar.debug = true;
+            } else {
+                msg(RUNTIME_ERROR, "option %s requires an argument.", argv[i - 1]);
+            }
         } else if (strcmp(argv[i], "-r") == 0) {
             if (++i < argc && argv[i][0] != '\0') {
                 pipebar.replace = argv[i];
@@ -1249,6 +2838,13 @@ static void init(int argc, char** argv)
     if (pipebar.color.size == sizeof(pixman_color_t)) {
         msg(RUNTIME_ERROR, "option -c need at least two color.");
     }
+    pixman_color_t* color;
+    wl_array_for_each(color, &pipebar.color)
+    {
+        pixman_image_t** fill = wl_array_add(&pipebar.fill, sizeof(pixman_image_t*));
+        *fill = pixman_image_create_solid_fill(color);
+        image_prepare(*fill);
+    }
 
     for (char *head = pipebar.fonts, *reader = pipebar.fonts;; reader++) {
         if (reader[0] != ',' && reader[0] != '\0') continue;
@@ -1260,11 +2856,6 @@ static void init(int argc, char** argv)
         }
         char** name = wl_array_add(&pipebar.font, sizeof(char*));
         *name = head;
-        struct fcft_font* font = fcft_from_name(1, (const char*[]) { *name }, "dpi=96");
-        if (font->height > pipebar.height) {
-            pipebar.height = font->height;
-        }
-        fcft_destroy(font);
         if (end) {
             break;
         } else {
@@ -1301,14 +2892,65 @@ static void init(int argc, char** argv)
     }
 }
 
+static void* preload(void* data)
+{
+    struct fcft_font** font = pipebar.preload.data;
+    char** font_name;
+    wl_array_for_each(font_name, &pipebar.font)
+    {
+        *font++ = fcft_from_name(1, (const char*[]) { *font_name }, "dpi=96");
+    }
+    return NULL;
+}
+
+static void preload_join()
+{
+    pthread_join(pipebar.preload_thread, NULL);
+    pipebar.preloading = false;
+
+    struct fcft_font** preload_font = pipebar.preload.data;
+    char** font_name;
+    wl_array_for_each(font_name, &pipebar.font)
+    {
+        if (*preload_font == NULL) {
+            msg(RUNTIME_ERROR, "failed to load font %s.", *font_name);
+        }
+        struct font* font = calloc(1, sizeof(struct font));
+        font->name = *font_name;
+        font->dpi = 96;
+        font->fcft_font = *preload_font;
+        *preload_font++ = NULL;
+        wl_list_insert(pipebar.font_cache.prev, &font->link);
+        if (font->fcft_font->height > pipebar.height) {
+            pipebar.height = font->fcft_font->height;
+            pipebar.height_font = font_name - (char**)pipebar.font.data;
+        }
+    }
+}
+
 static void setup()
 {
     set_pipe();
 
+    sigemptyset(&pipebar.signal);
+    sigaddset(&pipebar.signal, SIGTERM);
+    sigaddset(&pipebar.signal, SIGINT);
+    sigaddset(&pipebar.signal, SIGCHLD);
+    if (pipebar.debug) sigaddset(&pipebar.signal, SIGUSR1);
+    if (sigprocmask(SIG_BLOCK, &pipebar.signal, NULL) == -1) {
+        msg(INNER_ERROR, "failed to intercept signal.");
+    }
+
     if (!(fcft_capabilities() & FCFT_CAPABILITY_TEXT_RUN_SHAPING)) {
         msg(INNER_ERROR, "fcft version is lower then 2.4.0.");
     }
 
+    memset(wl_array_add(&pipebar.preload, pipebar.font.size / sizeof(char*) * sizeof(struct fcft_font*)), 0, pipebar.preload.size);
+    if (pthread_create(&pipebar.preload_thread, NULL, preload, NULL) != 0) {
+        msg(INNER_ERROR, "failed to create font loading thread.");
+    }
+    pipebar.preloading = true;
+
     pipebar.wl_display = wl_display_connect(NULL);
     if (pipebar.wl_display == NULL) {
         msg(INNER_ERROR, "failed to connect to wayland display.");
@@ -1330,18 +2972,417 @@ static void setup()
     } else if (pipebar.zwlr_layer_shell == NULL) {
         msg(INNER_ERROR, "failed to get wayland layer shell.");
     }
+    pipebar.startup_time[1] = now();
+
+    preload_join();
+    pipebar.startup_time[2] = now();
+
+    for (uint32_t i = 1; i < pipebar.jobs; i++) {
+        pthread_t* worker_thread = wl_array_add(&pipebar.worker, sizeof(pthread_t));
+        if (pthread_create(worker_thread, NULL, worker, NULL) != 0) {
+            pipebar.worker.size -= sizeof(pthread_t);
+            msg(INNER_ERROR, "failed to create render thread.");
+        }
+    }
 }
 
-static void loop()
+static void input_line(struct source* source, char* line, char* tail)
 {
-    sigset_t mask;
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGTERM);
-    sigaddset(&mask, SIGINT);
-    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
-        msg(INNER_ERROR, "failed to intercept signal.");
+    if (pipebar.record != NULL) record(source, line, tail - line);
+    if (source->slot_count == 0) return;
+    uint64_t line_hash = hash(line, tail - line);
+    if (line_hash == source->hash && source->line.size == tail - line && memcmp(source->line.data, line, tail - line) == 0) return;
+    source->hash = line_hash;
+    source->line.size = 0;
+    memcpy(wl_array_add(&source->line, tail - line), line, tail - line);
+    if (pipebar.debug) pipebar.line_time = now();
+    tail[0] = '\0';
+
+    bool escape = false;
+    for (char* reader = memchr(line, '\x1f', tail - line); reader != NULL; reader = memchr(reader + 1, '\x1f', tail - reader - 1)) {
+        reader[0] = '\0';
+        escape = !escape;
+        if (!escape && reader[-1] == '\0') {
+            msg(RUNTIME_ERROR, "empty between a pair of \\x1f.");
+        }
+    }
+    if (escape) {
+        msg(RUNTIME_ERROR, "got an odd number of '\\x1f'.");
+    }
+
+    parse(source, line, tail + 1);
+}
+
+static void input(struct source* source)
+{
+    struct wl_array* buffer = &source->buffer;
+    if (buffer->alloc - buffer->size < INPUT_CHUNK) {
+        wl_array_add(buffer, INPUT_CHUNK);
+        buffer->size -= INPUT_CHUNK;
+    }
+
+    ssize_t len = read(source->fd, (char*)buffer->data + buffer->size, buffer->alloc - buffer->size);
+    if (len == 0) {
+        if (source->fd == STDIN_FILENO && source->slot_count != 0) {
+            msg(NO_ERROR, "STDIN EOF.");
+        }
+        if (source->command == NULL) {
+            msg(WARNING, "%s EOF.", source->name);
+        } else if (buffer->size != 0) {
+            wl_array_add(buffer, 1);
+            input_line(source, buffer->data, (char*)buffer->data + buffer->size - 1);
+        }
+        if (source->fd != STDIN_FILENO) close(source->fd);
+        source->fd = -1;
+        buffer->size = 0;
+        return;
+    } else if (len < 0) {
+        if (errno == EAGAIN || errno == EINTR) return;
+        msg(INNER_ERROR, "failed to read from %s.", source->name);
+    }
+
+    char* head = buffer->data;
+    if (pipebar.binary && source->command == NULL) {
+        buffer->size += len;
+        char* reader = head;
+        uint32_t frame_len;
+        while (head + buffer->size - reader >= sizeof(frame_len)) {
+            memcpy(&frame_len, reader, sizeof(frame_len));
+            frame_len = le32toh(frame_len);
+            if (frame_len > FRAME_SIZE_MAX) {
+                msg(RUNTIME_ERROR, "got a %u bytes frame from %s, the limit is %u.", frame_len, source->name, FRAME_SIZE_MAX);
+            }
+            if (head + buffer->size - reader - sizeof(frame_len) < frame_len) break;
+            parse_frame(source, reader + sizeof(frame_len), frame_len);
+            reader += sizeof(frame_len) + frame_len;
+        }
+        buffer->size = head + buffer->size - reader;
+        memmove(head, reader, buffer->size);
+        return;
+    }
+
+    char* tail = memrchr(head + buffer->size, '\n', len);
+    buffer->size += len;
+    if (tail == NULL) return;
+
+    char* line = memrchr(head, '\n', tail - head);
+    line = line == NULL ? head : line + 1;
+
+    if (pipebar.record != NULL) {
+        for (char *reader = head, *end; reader < line; reader = end + 1) {
+            end = memchr(reader, '\n', line - reader);
+            record(source, reader, end - reader);
+        }
+    }
+    input_line(source, line, tail);
+
+    buffer->size = head + buffer->size - (tail + 1);
+    memmove(head, tail + 1, buffer->size);
+}
+
+static bool replay_read()
+{
+    char header[64];
+    uint64_t time;
+    uint32_t source_idx;
+    size_t len;
+    if (fgets(header, sizeof(header), pipebar.replay) == NULL) return false;
+    if (sscanf(header, "%" SCNu64 " %" SCNu32 " %zu", &time, &source_idx, &len) != 3) {
+        msg(RUNTIME_ERROR, "got an invalid record entry header.");
+    }
+
+    struct wl_array* line = &pipebar.replay_line;
+    line->size = 0;
+    if (wl_array_add(line, len + 1) == NULL) {
+        msg(INNER_ERROR, "failed to allocate record entry.");
+    }
+    if (fread(line->data, 1, len + 1, pipebar.replay) != len + 1) {
+        msg(WARNING, "got a truncated record entry.");
+        return false;
+    }
+    pipebar.replay_time = time;
+    pipebar.replay_source = source_idx;
+    return true;
+}
+
+static int replay(uint64_t time)
+{
+    if (pipebar.replay_start == 0) pipebar.replay_start = time;
+    while (pipebar.replay_end == 0) {
+        if (!pipebar.replay_pending) {
+            if (!replay_read()) {
+                pipebar.replay_end = time;
+                break;
+            }
+            if (pipebar.replay_count == 0) pipebar.replay_first = pipebar.replay_time;
+            pipebar.replay_pending = true;
+        }
+        if (pipebar.replay_speed != 0) {
+            uint64_t due = pipebar.replay_start + (pipebar.replay_time - pipebar.replay_first) / pipebar.replay_speed;
+            if (due > time) return (due - time + 999999) / 1000000;
+        }
+
+        if (pipebar.replay_source < pipebar.source.size / sizeof(struct source)) {
+            struct source* source = (struct source*)pipebar.source.data + pipebar.replay_source;
+            char* line = pipebar.replay_line.data;
+            size_t len = pipebar.replay_line.size - 1;
+            if (pipebar.binary && source->command == NULL) {
+                parse_frame(source, line, len);
+            } else {
+                input_line(source, line, line + len);
+            }
+        } else {
+            msg(WARNING, "record entry source %u is out of range.", pipebar.replay_source);
+        }
+        pipebar.replay_pending = false;
+        pipebar.replay_count++;
+        if (pipebar.replay_speed == 0) return 0;
+    }
+
+    bool busy = !wl_list_empty(&pipebar.trace);
+    uint64_t frames = 0;
+    struct bar* bar;
+    wl_list_for_each(bar, &pipebar.bar, link)
+    {
+        busy |= bar->redraw || bar->wl_callback != NULL;
+        frames += bar->frame;
+    }
+    if (busy && time - pipebar.replay_end < 1000000000ull) return 10;
+
+    double duration = (pipebar.replay_end - pipebar.replay_start) / 1e9;
+    msg(WARNING, "replay: %u lines in %.3fs, %.1f lines/s, %" PRIu64 " frames, %.1f frames/s.",
+        pipebar.replay_count, duration, duration == 0 ? 0.0 : pipebar.replay_count / duration,
+        frames, duration == 0 ? 0.0 : frames / duration);
+    trace_dump();
+    msg(NO_ERROR, "Replay finished.");
+    return -1;
+}
+
+static char* module_read(struct source* source, int fd_idx)
+{
+    struct wl_array* buffer = &source->buffer;
+    while (true) {
+        if (buffer->alloc == 0) {
+            wl_array_add(buffer, 4096);
+        }
+        ssize_t len = pread(source->module_fd[fd_idx], buffer->data, buffer->alloc - 1, 0);
+        if (len < 0) len = 0;
+        if (len < buffer->alloc - 1) {
+            ((char*)buffer->data)[len] = '\0';
+            buffer->size = 0;
+            return buffer->data;
+        }
+        buffer->size = buffer->alloc;
+        wl_array_add(buffer, buffer->alloc);
+    }
+}
+
+static void module_update(struct source* source)
+{
+    if (source->fd >= 0) {
+        char event[sizeof(struct inotify_event) + NAME_MAX + 1];
+        while (read(source->fd, event, sizeof(event)) > 0) { }
+    }
+
+    char value[32];
+    uint64_t sample_time = now();
+    switch (source->module) {
+    case MODULE_CPU: {
+        char* reader = module_read(source, 0) + strlen("cpu");
+        uint64_t total = 0, idle = 0;
+        for (int i = 0; i < 8; i++) {
+            uint64_t field = strtoull(reader, &reader, 10);
+            total += field;
+            if (i == 3 || i == 4) idle += field;
+        }
+        uint64_t total_delta = total - source->module_last[0];
+        uint64_t idle_delta = idle - source->module_last[1];
+        snprintf(value, sizeof(value), "%3u", total_delta == 0 ? 0 : (unsigned)((total_delta - idle_delta) * 100 / total_delta));
+        source->module_last[0] = total;
+        source->module_last[1] = idle;
+        break;
+    }
+    case MODULE_MEM: {
+        const char* text = module_read(source, 0);
+        const char* mem_total = strstr(text, "MemTotal:");
+        const char* mem_available = strstr(text, "MemAvailable:");
+        uint64_t total = mem_total == NULL ? 0 : strtoull(mem_total + strlen("MemTotal:"), NULL, 10);
+        uint64_t available = mem_available == NULL ? 0 : strtoull(mem_available + strlen("MemAvailable:"), NULL, 10);
+        snprintf(value, sizeof(value), "%3u", total == 0 ? 0 : (unsigned)((total - available) * 100 / total));
+        break;
+    }
+    case MODULE_NET: {
+        char* reader = module_read(source, 0);
+        uint64_t bytes = 0;
+        for (int i = 0; i < 2 && reader != NULL; i++) {
+            reader = strchr(reader, '\n');
+            if (reader != NULL) reader++;
+        }
+        while (reader != NULL && reader[0] != '\0') {
+            char* colon = strchr(reader, ':');
+            if (colon == NULL) break;
+            reader += strspn(reader, " ");
+            if (colon - reader != 2 || strncmp(reader, "lo", 2) != 0) {
+                char* field = colon + 1;
+                for (int i = 0; i < 9; i++) {
+                    uint64_t count = strtoull(field, &field, 10);
+                    if (i == 0 || i == 8) bytes += count;
+                }
+            }
+            reader = strchr(colon, '\n');
+            if (reader != NULL) reader++;
+        }
+        uint64_t rate = source->module_last[1] == 0 ? 0 : (bytes - source->module_last[0]) * 1000000000ull / (sample_time - source->module_last[1]);
+        if (rate < 1000) {
+            snprintf(value, sizeof(value), " %3uB/s", (unsigned)rate);
+        } else if (rate < 1000000) {
+            snprintf(value, sizeof(value), "%3ukB/s", (unsigned)(rate / 1000));
+        } else if (rate < 1000000000) {
+            snprintf(value, sizeof(value), "%3uMB/s", (unsigned)(rate / 1000000));
+        } else {
+            snprintf(value, sizeof(value), "%3uGB/s", (unsigned)(rate / 1000000000));
+        }
+        source->module_last[0] = bytes;
+        source->module_last[1] = sample_time;
+        break;
+    }
+    case MODULE_BACKLIGHT: {
+        uint64_t max_brightness = strtoull(module_read(source, 1), NULL, 10);
+        uint64_t brightness = strtoull(module_read(source, 0), NULL, 10);
+        snprintf(value, sizeof(value), "%3u", max_brightness == 0 ? 0 : (unsigned)((brightness * 100 + max_brightness / 2) / max_brightness));
+        break;
+    }
+    }
+
+    struct wl_array* buffer = &source->buffer;
+    buffer->size = 0;
+    if (source->module == MODULE_CLOCK) {
+        time_t clock = time(NULL);
+        struct tm tm;
+        localtime_r(&clock, &tm);
+        while (true) {
+            if (buffer->alloc == 0) {
+                wl_array_add(buffer, 4096);
+            }
+            buffer->size = strftime(buffer->data, buffer->alloc - 1, source->format, &tm);
+            if (buffer->size != 0 || buffer->alloc >= INPUT_CHUNK) break;
+            buffer->size = buffer->alloc;
+            wl_array_add(buffer, buffer->alloc);
+            buffer->size = 0;
+        }
+    } else {
+        size_t replace_len = strlen(pipebar.replace);
+        for (const char* reader = source->format;;) {
+            const char* found = strstr(reader, pipebar.replace);
+            size_t chunk_len = found == NULL ? strlen(reader) : found - reader;
+            memcpy(wl_array_add(buffer, chunk_len), reader, chunk_len);
+            if (found == NULL) break;
+            memcpy(wl_array_add(buffer, strlen(value)), value, strlen(value));
+            reader = found + replace_len;
+        }
+    }
+    wl_array_add(buffer, 1);
+    input_line(source, buffer->data, (char*)buffer->data + buffer->size - 1);
+}
+
+static void block_backoff(struct source* source)
+{
+    struct itimerspec timer = { .it_value = { .tv_sec = source->backoff } };
+    timerfd_settime(source->timer_fd, 0, &timer, NULL);
+    if (source->backoff < BLOCK_BACKOFF_MAX) source->backoff *= 2;
+}
+
+static void block_spawn(struct source* source)
+{
+    source->spawn_time = now();
+    int pipe_fd[2];
+    if (pipe2(pipe_fd, O_CLOEXEC) < 0) {
+        msg(WARNING, "failed to create pipe for block %s.", source->name);
+        if (source->interval == 0) block_backoff(source);
+        return;
+    }
+
+    source->pid = spawn(source->command, pipe_fd[1]);
+    close(pipe_fd[1]);
+    if (source->pid < 0) {
+        msg(WARNING, "failed to spawn block %s.", source->name);
+        source->pid = 0;
+        close(pipe_fd[0]);
+        if (source->interval == 0) block_backoff(source);
+        return;
+    }
+
+    while (source->fd >= 0 && poll(&(struct pollfd) { .fd = source->fd, .events = POLLIN }, 1, 0) > 0) {
+        input(source);
+    }
+    if (source->fd >= 0) close(source->fd);
+    source->buffer.size = 0;
+    source->fd = pipe_fd[0];
+    fcntl(source->fd, F_SETFL, O_NONBLOCK);
+}
+
+static void block_start(struct source* source)
+{
+    if (source->module != MODULE_NONE) {
+        module_update(source);
+    } else {
+        block_spawn(source);
+    }
+    if (source->interval == 0) return;
+
+    struct timespec time;
+    clock_gettime(CLOCK_REALTIME, &time);
+    struct itimerspec timer = {
+        .it_interval = { .tv_sec = source->interval },
+        .it_value = { .tv_sec = (time.tv_sec / source->interval + 1) * source->interval },
+    };
+    if (timerfd_settime(source->timer_fd, TFD_TIMER_ABSTIME, &timer, NULL) < 0) {
+        msg(INNER_ERROR, "failed to arm block timer.");
+    }
+}
+
+static void block_tick(struct source* source)
+{
+    uint64_t expirations;
+    if (read(source->timer_fd, &expirations, sizeof(expirations)) < 0) return;
+    if (source->module != MODULE_NONE) {
+        module_update(source);
+    } else if (source->pid == 0) {
+        block_spawn(source);
+    }
+}
+
+static void reap()
+{
+    pid_t pid;
+    int status;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        bool block = false;
+        struct source* source;
+        wl_array_for_each(source, &pipebar.source)
+        {
+            if (source->pid != pid) continue;
+            block = true;
+            source->pid = 0;
+            if (source->interval != 0) break;
+
+            if (now() - source->spawn_time > BLOCK_BACKOFF_MAX * 1000000000ull) {
+                source->backoff = BLOCK_BACKOFF_MIN;
+            }
+            msg(WARNING, "block %s exited, restart in %us.", source->name, source->backoff);
+            block_backoff(source);
+            break;
+        }
+        if (!block && pipebar.action_running > 0) {
+            pipebar.action_running--;
+        }
     }
-    int signal_fd = signalfd(-1, &mask, SFD_NONBLOCK);
+    action_flush();
+}
+
+static void loop()
+{
+    int signal_fd = signalfd(-1, &pipebar.signal, SFD_NONBLOCK | SFD_CLOEXEC);
     if (signal_fd < 0) {
         msg(INNER_ERROR, "failed to create signal fd.");
     }
@@ -1351,73 +3392,298 @@ static void loop()
         msg(INNER_ERROR, "failed to get wayland display fd.");
     }
 
-    int stdin_fd = STDIN_FILENO;
+    size_t source_count = pipebar.source.size / sizeof(struct source);
+    struct source* source = pipebar.source.data;
+    for (size_t i = 0; i < source_count; i++) {
+        if (source[i].command != NULL && pipebar.replay == NULL) block_start(&source[i]);
+    }
 
-    struct pollfd pfds[] = {
-        { .fd = signal_fd, .events = POLLIN },
-        { .fd = stdin_fd, .events = POLLIN },
-        { .fd = wl_display_fd, .events = POLLIN },
-    };
+    struct pollfd pfds[3 + source_count * 2];
+    struct pollfd* source_pfds = pfds + 3;
+    struct pollfd* timer_pfds = pfds + 3 + source_count;
+    pfds[0] = (struct pollfd) { .fd = signal_fd, .events = POLLIN };
+    pfds[1] = (struct pollfd) { .fd = wl_display_fd, .events = POLLIN };
+    pfds[2] = (struct pollfd) { .fd = -1, .events = POLLOUT };
+    for (size_t i = 0; i < source_count; i++) {
+        source_pfds[i] = (struct pollfd) { .fd = source[i].fd, .events = POLLIN };
+        timer_pfds[i] = (struct pollfd) { .fd = source[i].timer_fd, .events = POLLIN };
+    }
 
-    int x1f_count = 0;
-    char* reader = NULL;
+    int timeout = -1;
     while (true) {
         wl_display_flush(pipebar.wl_display);
 
-        if (poll(pfds, 3, -1) < 0) {
+        pfds[2].fd = pipebar.exec == 0 && pipebar.action_queue.size != 0 ? STDOUT_FILENO : -1;
+        for (size_t i = 0; i < source_count; i++) {
+            source_pfds[i].fd = pipebar.replay == NULL ? source[i].fd : -1;
+        }
+        if (poll(pfds, 3 + source_count * 2, timeout) < 0) {
             msg(INNER_ERROR, "failed to wait for data using poll.");
         }
 
         if (pfds[0].revents & POLLIN) {
-            msg(NO_ERROR, "Interrupted by signal.");
+            struct signalfd_siginfo siginfo;
+            while (read(signal_fd, &siginfo, sizeof(siginfo)) == sizeof(siginfo)) {
+                if (siginfo.ssi_signo == SIGUSR1) {
+                    trace_dump();
+                } else if (siginfo.ssi_signo != SIGCHLD) {
+                    msg(NO_ERROR, "Interrupted by signal.");
+                }
+            }
+            reap();
         }
 
-        if (pfds[1].revents & POLLHUP) {
-            msg(NO_ERROR, "STDIN EOF.");
+        if (pfds[2].revents & (POLLOUT | POLLERR)) {
+            action_flush();
         }
 
-        if (pfds[1].revents & POLLIN) {
-            reader = wl_array_add(&pipebar.text[1], 1);
-            read(stdin_fd, reader, 1);
-            if (reader[0] == '\x1f') {
-                reader[0] = '\0';
-                x1f_count++;
-                if (x1f_count % 2 == 0 && reader[-1] == '\0') {
-                    msg(RUNTIME_ERROR, "empty between a pair of \\x1f.");
-                }
-            } else if (reader[0] == '\n') {
-                if (x1f_count % 2 == 0) {
-                    reader[0] = '\0';
-
-                    struct wl_array text_tmp = pipebar.text[0];
-                    pipebar.text[0] = pipebar.text[1];
-                    pipebar.text[1] = text_tmp;
-                    pipebar.text[1].size = 0;
-                    x1f_count = 0;
-
-                    parse();
+        for (size_t i = 0; i < source_count; i++) {
+            if (source_pfds[i].revents & (POLLIN | POLLHUP)) {
+                if (source[i].module != MODULE_NONE) {
+                    module_update(&source[i]);
                 } else {
-                    msg(RUNTIME_ERROR, "got an odd number of '\\x1f'.");
+                    input(&source[i]);
                 }
             }
+            if (timer_pfds[i].revents & POLLIN) {
+                block_tick(&source[i]);
+            }
         }
 
-        if (pfds[2].revents & POLLIN) {
+        if (pfds[1].revents & POLLIN) {
             if (wl_display_dispatch(pipebar.wl_display) < 0) {
                 msg(INNER_ERROR, "failed to handle wayland display event queue.");
             }
         }
 
+        uint64_t time = now();
+        timeout = action_throttle(time);
+        if (pipebar.replay != NULL) {
+            int wait = replay(time);
+            if (timeout < 0 || wait < timeout) timeout = wait;
+        }
+        pipebar.job.size = 0;
         struct bar* bar;
         wl_list_for_each(bar, &pipebar.bar, link)
         {
-            if (bar->redraw && bar->width != 0 && bar->scale != 0) {
-                draw(bar);
+            if (!bar->redraw || bar->width == 0 || bar->scale == 0 || bar->wl_callback != NULL) continue;
+            if (pipebar.fps != 0 && time - bar->time < 1000000000ull / pipebar.fps) {
+                int wait = (1000000000ull / pipebar.fps - (time - bar->time) + 999999) / 1000000;
+                if (timeout < 0 || wait < timeout) timeout = wait;
+                continue;
             }
+            if (layout(bar)) {
+                *(struct bar**)wl_array_add(&pipebar.job, sizeof(struct bar*)) = bar;
+            }
+        }
+        render_jobs();
+        struct bar** job;
+        wl_array_for_each(job, &pipebar.job)
+        {
+            commit(*job);
         }
     }
 }
 
+#ifdef BENCH
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* data, size_t size);
+static uint64_t bench_alloc;
+
+void* malloc(size_t size)
+{
+    __atomic_fetch_add(&bench_alloc, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size)
+{
+    __atomic_fetch_add(&bench_alloc, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* data, size_t size)
+{
+    __atomic_fetch_add(&bench_alloc, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(data, size);
+}
+
+enum {
+    BENCH_ASCII,
+    BENCH_ICONS,
+    BENCH_BLOCKS,
+    BENCH_ESCAPES,
+    BENCH_SIZE,
+};
+
+enum {
+    BENCH_STAGE_PARSE,
+    BENCH_STAGE_SHAPE,
+    BENCH_STAGE_COMPOSITE,
+    BENCH_STAGE_COMMIT,
+    BENCH_STAGE_SIZE,
+};
+
+static void bench_append(struct wl_array* line, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    char* text = wl_array_add(line, len + 1);
+    va_start(ap, fmt);
+    vsnprintf(text, len + 1, fmt, ap);
+    va_end(ap);
+    line->size--;
+}
+
+static void bench_line(struct wl_array* line, int workload, uint32_t iteration)
+{
+    uint32_t color_count = pipebar.color.size / sizeof(pixman_color_t);
+    line->size = 0;
+    switch (workload) {
+    case BENCH_ASCII:
+        for (uint32_t k = 0; k < 16; k++) {
+            bench_append(line, "the quick brown fox jumps over the lazy dog %u ", iteration + k);
+        }
+        bench_append(line, "\x1f" "D\x1f%u\x1f" "D\x1f" "12:%02u", iteration, iteration % 60);
+        break;
+    case BENCH_ICONS:
+        for (uint32_t k = 0; k < 120; k++) {
+            uint32_t codepoint = 0xf000 + (k * 7 + iteration) % 0x2e0;
+            bench_append(line, "%c%c%c ", 0xe0 | codepoint >> 12, 0x80 | (codepoint >> 6 & 0x3f), 0x80 | (codepoint & 0x3f));
+        }
+        bench_append(line, "\x1f" "D\x1f\uf017 %u\x1f" "D\x1f\uf240 %u%%", iteration, iteration % 100);
+        break;
+    case BENCH_BLOCKS:
+        for (uint32_t k = 0; k < 200; k++) {
+            if (k == 67 || k == 134) bench_append(line, "\x1f" "D\x1f");
+            bench_append(line, "\x1f" "1click %u\x1f\x1fR\x1f %u \x1f" "1\x1f", k, k == 0 ? iteration : k);
+        }
+        break;
+    case BENCH_ESCAPES:
+        for (uint32_t k = 0; k < 50; k++) {
+            bench_append(line, "\x1f" "B%u\x1f\x1f" "F%u\x1f\x1fT0\x1f\x1f" "1a%u\x1f\x1f" "4up\x1f\x1f" "5down\x1f%u\x1f" "5\x1f\x1f" "4\x1f\x1f" "1\x1f\x1fT\x1f\x1f" "F\x1f\x1f" "B\x1f",
+                k % color_count, (k + 1) % color_count, k, k == 0 ? iteration % 10 : k % 10);
+        }
+        bench_append(line, "\x1f" "D\x1f%u\x1f" "D\x1f", iteration);
+        break;
+    }
+    bench_append(line, "\n");
+}
+
+static void bench_commit(struct bar* bar)
+{
+    bar->frame++;
+    bar->pending->frame = bar->frame;
+    bar->pending = NULL;
+}
+
+static void bench(int argc, char** argv)
+{
+    uint32_t lines = 1000;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "-k") == 0) lines = strtoul(argv[i + 1], NULL, 10);
+    }
+
+    struct source* source = wl_array_add(&pipebar.source, sizeof(struct source));
+    *source = (struct source) { .name = "bench", .fd = -1, .timer_fd = -1, .slot_count = PART_SIZE };
+    wl_array_init(&source->buffer);
+    wl_array_init(&source->line);
+    source->hash = hash(NULL, 0);
+    for (int part_idx = PART_LEFT; part_idx < PART_SIZE; part_idx++) {
+        struct slot* slot = wl_array_add(&pipebar.slot, sizeof(struct slot));
+        *slot = (struct slot) { .part = part_idx, .hash = hash(NULL, 0) };
+        wl_array_init(&slot->text);
+        wl_list_init(&slot->entry);
+    }
+
+    memset(wl_array_add(&pipebar.preload, pipebar.font.size / sizeof(char*) * sizeof(struct fcft_font*)), 0, pipebar.preload.size);
+    if (pthread_create(&pipebar.preload_thread, NULL, preload, NULL) != 0) {
+        msg(INNER_ERROR, "failed to create font loading thread.");
+    }
+    pipebar.preloading = true;
+    preload_join();
+    for (uint32_t i = 1; i < pipebar.jobs; i++) {
+        pthread_t* worker_thread = wl_array_add(&pipebar.worker, sizeof(pthread_t));
+        if (pthread_create(worker_thread, NULL, worker, NULL) != 0) {
+            pipebar.worker.size -= sizeof(pthread_t);
+            msg(INNER_ERROR, "failed to create render thread.");
+        }
+    }
+
+    static const char* workload_name[BENCH_SIZE] = { "ascii", "icons", "blocks", "escapes" };
+    static const uint32_t scale[] = { 120, 150, 180, 240 };
+    struct wl_array line;
+    wl_array_init(&line);
+    for (int scale_idx = 0; scale_idx < sizeof(scale) / sizeof(scale[0]); scale_idx++) {
+        struct bar* bar = bar_new(NULL, 0);
+        bar->output = 1u << OUTPUT_SIZE;
+        bar->width = 1920;
+        wp_fractional_scale_handle_preferred_scale(bar, NULL, scale[scale_idx]);
+        for (int workload = 0; workload < BENCH_SIZE; workload++) {
+            uint64_t stage_time[BENCH_STAGE_SIZE] = {};
+            uint64_t alloc = 0, frames = 0;
+            uint32_t canvas_count = pipebar.canvas_count, run_miss = pipebar.run_miss, run_hit = pipebar.run_hit;
+            for (uint32_t iteration = 0; iteration < lines + lines / 16; iteration++) {
+                bench_line(&line, workload, iteration);
+                bool warm = iteration >= lines / 16;
+                uint64_t alloc_start = bench_alloc;
+                uint64_t time[BENCH_STAGE_SIZE + 1];
+                time[0] = now();
+                input_line(source, line.data, (char*)line.data + line.size - 1);
+                time[1] = now();
+                pipebar.job.size = 0;
+                if (layout(bar)) {
+                    *(struct bar**)wl_array_add(&pipebar.job, sizeof(struct bar*)) = bar;
+                }
+                time[2] = now();
+                render_jobs();
+                time[3] = now();
+                struct bar** job;
+                wl_array_for_each(job, &pipebar.job)
+                {
+                    bench_commit(*job);
+                    frames += warm;
+                }
+                time[4] = now();
+                if (!warm) continue;
+                for (int stage = 0; stage < BENCH_STAGE_SIZE; stage++) {
+                    stage_time[stage] += time[stage + 1] - time[stage];
+                }
+                alloc += bench_alloc - alloc_start;
+            }
+
+            if (pipebar.run_miss - run_miss + pipebar.run_hit - run_hit == 0) {
+                msg(INNER_ERROR, "bench workload %s produced an empty frame.", workload_name[workload]);
+            }
+            uint64_t total = 0;
+            for (int stage = 0; stage < BENCH_STAGE_SIZE; stage++) {
+                total += stage_time[stage];
+            }
+            printf("{\"workload\":\"%s\",\"scale\":%.2f,\"width\":%u,\"lines\":%u,\"frames\":%" PRIu64 ","
+                   "\"ns_per_line\":%" PRIu64 ",\"parse_ns\":%" PRIu64 ",\"shape_ns\":%" PRIu64 ",\"composite_ns\":%" PRIu64 ",\"commit_ns\":%" PRIu64 ","
+                   "\"allocs_per_frame\":%.2f,\"canvases\":%u,\"runs_shaped\":%u}\n",
+                workload_name[workload], scale[scale_idx] / 120.0, bar->canvas_width, lines, frames,
+                total / lines, stage_time[BENCH_STAGE_PARSE] / lines, stage_time[BENCH_STAGE_SHAPE] / lines,
+                stage_time[BENCH_STAGE_COMPOSITE] / lines, stage_time[BENCH_STAGE_COMMIT] / lines,
+                frames == 0 ? 0.0 : (double)alloc / frames, pipebar.canvas_count - canvas_count, pipebar.run_miss - run_miss);
+        }
+        bar_destroy(bar);
+    }
+    wl_array_release(&line);
+}
+
+int main(int argc, char** argv)
+{
+    init(argc, argv);
+    bench(argc, argv);
+    pipebar_destroy();
+
+    return NO_ERROR;
+}
+#else
 int main(int argc, char** argv)
 {
     init(argc, argv);
@@ -1426,3 +3692,4 @@ int main(int argc, char** argv)
 
     return NO_ERROR;
 }
+#endif